@@ -5,6 +5,7 @@
 #include "../Shared/CollisionSystem.h"
 #include "../Shared/Sphere.h"
 #include "../Shared/OBB.h"
+#include <algorithm>
 
 
 Client::Client() :
@@ -14,6 +15,7 @@ Client::Client() :
 	myClientObject = nullptr;
 	lastUpdateTime = RakNet::GetTime();
 	clientID = -1;
+	receivedSnapshots.resize(receivedSnapshotCount);
 }
 
 Client::~Client()
@@ -32,13 +34,13 @@ Collider* Client::readCollider(RakNet::BitStream& bsIn)
 
 	switch (shapeID)
 	{
-	case 0:	//Sphere
+	case ShapeID<Sphere>::value:
 	{
 		float radius;
 		bsIn.Read(radius);
 		return new Sphere(radius);
 	}
-	case 1:	//OBB
+	case ShapeID<OBB>::value:
 	{
 		raylib::Vector3 extents;
 		bsIn.Read(extents);
@@ -64,6 +66,8 @@ void Client::createStaticObjects(RakNet::BitStream& bsIn)
 
 		bsIn.Read(info.state.position);
 		bsIn.Read(info.state.rotation);
+		bsIn.Read(info.collisionCategory);
+		bsIn.Read(info.collisionMask);
 
 
 		// Use factory method to create object, making sure it was made correctly
@@ -84,6 +88,7 @@ void Client::createStaticObjects(RakNet::BitStream& bsIn)
 			throw new std::exception(str.c_str());
 		}
 
+		obj->setCollisionFilter(info.collisionCategory, info.collisionMask);
 		staticObjects.push_back(obj);
 	}
 }
@@ -104,6 +109,21 @@ void Client::createGameObject(RakNet::BitStream& bsIn)
 		}
 	}
 
+	// The server reuses a slot as soon as it is freed, and creates and destroys can arrive out of order, so the slot might still
+	// hold another generation. Only the newest generation still exists on the server, so the older object is dropped
+	unsigned int slotID = gameObjects.getSlotID(objectID);
+	if (slotID != SlotMap::invalidID && slotID != objectID)
+	{
+		if (SlotMap::isNewer(slotID, objectID))
+		{
+			replacedObjectIDs.push_back(objectID);
+			return;
+		}
+
+		destroyGameObject(slotID);
+		replacedObjectIDs.push_back(slotID);
+	}
+
 	int typeID;
 	bsIn.Read(typeID);
 	ObjectInfo info;
@@ -112,11 +132,14 @@ void Client::createGameObject(RakNet::BitStream& bsIn)
 
 	bsIn.Read(info.state.position);
 	bsIn.Read(info.state.rotation);
+	bsIn.Read(info.collisionCategory);
+	bsIn.Read(info.collisionMask);
 	bsIn.Read(info.state.velocity);
 	bsIn.Read(info.state.angularVelocity);
 	bsIn.Read(info.mass);
 	bsIn.Read(info.elasticity);
 	bsIn.Read(info.friction);
+	bsIn.Read(info.isAwake);
 
 
 	// Use factory method to create object, making sure it was made correctly
@@ -137,7 +160,20 @@ void Client::createGameObject(RakNet::BitStream& bsIn)
 		throw new std::exception(str.c_str());
 	}
 
-	gameObjects[objectID] = obj;
+	obj->setCollisionFilter(info.collisionCategory, info.collisionMask);
+	// Objects that are asleep on the server dont send updates, so need to start asleep
+	if (!info.isAwake)
+	{
+		obj->sleep();
+	}
+
+	if (!gameObjects.add(obj))
+	{
+		// An object with this ID already exists
+		delete obj;
+		return;
+	}
+	broadphase.addObject(obj);
 }
 
 void Client::createClientObject(RakNet::BitStream& bsIn)
@@ -153,11 +189,14 @@ void Client::createClientObject(RakNet::BitStream& bsIn)
 
 	bsIn.Read(info.state.position);
 	bsIn.Read(info.state.rotation);
+	bsIn.Read(info.collisionCategory);
+	bsIn.Read(info.collisionMask);
 	bsIn.Read(info.state.velocity);
 	bsIn.Read(info.state.angularVelocity);
 	bsIn.Read(info.mass);
 	bsIn.Read(info.elasticity);
 	bsIn.Read(info.friction);
+	bsIn.Read(info.isAwake);
 
 
 	// Use factory method to create object, making sure it was made correctly
@@ -178,27 +217,40 @@ void Client::createClientObject(RakNet::BitStream& bsIn)
 		throw new std::exception(str.c_str());
 	}
 
+	obj->setCollisionFilter(info.collisionCategory, info.collisionMask);
 	myClientObject = obj;
+	broadphase.addObject(obj);
 }
 
 
 void Client::destroyGameObject(unsigned int objectID)
 {
 	// If the object doesnt exist, add it to the blacklist incase we receved this package early
-	if (gameObjects.count(objectID) == 0)
+	GameObject* object = gameObjects.find(objectID);
+	if (!object)
 	{
+		// Objects replaced by a newer generation have already been removed
+		auto replaced = std::find(replacedObjectIDs.begin(), replacedObjectIDs.end(), objectID);
+		if (replaced != replacedObjectIDs.end())
+		{
+			replacedObjectIDs.erase(replaced);
+			return;
+		}
+
 		objectIDBlacklist.push_back(objectID);
 		return;
 	}
 
-	// Delete the object and remove it from the map
-	delete gameObjects[objectID];
-	gameObjects.erase(objectID);
+	// Delete the object and remove it from the storage
+	broadphase.removeObject(object);
+	gameObjects.remove(object);
+	delete object;
 }
 
 void Client::destroyAllObjects()
 {
 	clientID = -1;
+	broadphase.clear();
 
 	// Destroy static objects
 	for (auto it : staticObjects)
@@ -207,12 +259,14 @@ void Client::destroyAllObjects()
 	}
 	staticObjects.clear();
 
-	// Destroy game objects
-	for (auto& it : gameObjects)
+	// Destroy game objects, taking each out of the storage first. Removing the last one doesnt move anything
+	while (!gameObjects.empty())
 	{
-		delete it.second;
+		GameObject* object = gameObjects.getObject(gameObjects.size() - 1);
+		gameObjects.remove(object);
+		delete object;
 	}
-	gameObjects.clear();
+	replacedObjectIDs.clear();
 
 	// Destroy client object
 	if (myClientObject)
@@ -220,6 +274,13 @@ void Client::destroyAllObjects()
 		delete myClientObject;
 		myClientObject = nullptr;
 	}
+
+	// Snapshots from this server cant be used as baselines by the next one
+	receivedSnapshots.assign(receivedSnapshotCount, ReceivedSnapshot());
+	collectingSnapshot = ReceivedSnapshot();
+	collectingPackets = 0;
+	collectingPacketCount = 0;
+	ackedSnapshot = 0;
 }
 
 
@@ -229,85 +290,200 @@ void Client::applyServerUpdate(RakNet::BitStream& bsIn, const RakNet::Time& time
 	unsigned int id;
 	bsIn.Read(id);
 
-	// Get the updated physics state
+	// Get the updated physics state, quantized with the profile the server chose
 	PhysicsState state;
-	bsIn.Read(state.position);
-	bsIn.Read(state.rotation);
-	bsIn.Read(state.velocity);
-	bsIn.Read(state.angularVelocity);
-
+	bool isAwake;
+	if (stateQuantizer.read(bsIn, state) && bsIn.Read(isAwake))
+	{
+		applyObjectState(id, state, isAwake, timeStamp);
+	}
+}
 
+void Client::applyObjectState(unsigned int id, const PhysicsState& state, bool isAwake, const RakNet::Time& timeStamp)
+{
+	GameObject* object = gameObjects.find(id);
 	if (id == clientID)
 	{
 		// Because we applied the input from the receved state, we are 1 RTT ahead of this state
 		// It took 1/2 RTT for this packet to get to us, so we add the other half
 		int halfPing = peerInterface->GetLastPing(peerInterface->GetSystemAddressFromIndex(0)) / 2;
 
+		updateStaticWorld();
 		// Lambda function to do collision between the client object and static and game objects, only affecting the client object
 		auto collisionFunc = [this]()
 		{
-			for (auto& gameObjIt = gameObjects.begin(); gameObjIt != gameObjects.end(); gameObjIt++)
-			{
-				CollisionSystem::handleCollision(myClientObject, gameObjIt->second, false);
-			}
-			for (auto& staticObj : staticObjects)
+			// The client object is moved while reapplying input, so use its current box instead of its proxy
+			broadphase.query(myClientObject->getAABB(), [this](StaticObject* other)
 			{
-				CollisionSystem::handleCollision(myClientObject, staticObj, false);
-			}
+				if (other != myClientObject)
+				{
+					CollisionSystem::handleCollision(myClientObject, other, false);
+				}
+			});
 		};
 
 
 		// Update myClientObject with input buffer
 		myClientObject->updateStateWithInputBuffer(state, timeStamp - halfPing, RakNet::GetTime(), inputBuffer, true, collisionFunc);
 	}
-	else if (gameObjects.count(id) > 0)	//gameObjects has more than 0 entries of id
+	else if (object)
 	{
-		// Update the game object, with smoothing
-		gameObjects[id]->updateState(state, timeStamp, timeStamp/*RakNet::GetTime()*/, true);
+		// Older updates are ignored, including whether the object is awake
+		bool isNewest = timeStamp >= object->getTime();
+
+		// Update the game object, with smoothing. The last update before sleeping is set directly, since nothing will correct it later
+		object->updateState(state, timeStamp, timeStamp/*RakNet::GetTime()*/, isAwake);
+		if (isNewest)
+		{
+			if (isAwake)
+			{
+				object->wake();
+			}
+			else
+			{
+				object->sleep();
+			}
+		}
 	}
+
 }
 
 
-void Client::systemUpdate()
+void Client::applySnapshot(RakNet::BitStream& bsIn, const RakNet::Time& timeStamp)
 {
-	RakNet::Time currentTime = RakNet::GetTime();
-	float deltaTime = (currentTime - lastUpdateTime) * 0.001f;
+	unsigned int sequence;
+	unsigned int baselineSequence;
+	unsigned short packetIndex;
+	if (!bsIn.Read(sequence) || !bsIn.Read(baselineSequence) || !bsIn.Read(packetIndex))
+	{
+		return;
+	}
+
+	// Awake objects are sent as differences from a snapshot we acknowledged. If it is too old to still have, the packet cant be read
+	const ReceivedSnapshot* baseline = nullptr;
+	if (baselineSequence != 0)
+	{
+		baseline = &receivedSnapshots[baselineSequence % receivedSnapshotCount];
+		if (baseline->sequence != baselineSequence)
+		{
+			return;
+		}
+	}
+
+	// Packets from a newer snapshot start collecting it, dropping any older one that didnt fully arrive
+	bool isCollecting = sequence != 0 && sequence >= collectingSnapshot.sequence;
+	if (isCollecting && sequence > collectingSnapshot.sequence)
+	{
+		collectingSnapshot.sequence = sequence;
+		collectingSnapshot.states.clear();
+		collectingPackets = 0;
+		collectingPacketCount = 0;
+	}
 
 
-	// Predict collisions
+	// Each update is marked, and a false mark ends the snapshot. Stop if an update cant be read, since the rest would be read from the wrong place
+	bool hasUpdate;
+	while (bsIn.Read(hasUpdate) && hasUpdate)
 	{
-		// Game objects with static, other game objects, and our client object
-		for (auto& gameObjIt = gameObjects.begin(); gameObjIt != gameObjects.end(); gameObjIt++)
+		unsigned int id;
+		if (!bsIn.Read(id))
 		{
-			GameObject* gameObj = gameObjIt->second;
+			return;
+		}
 
-			// Static objects
-			for (auto& staticObj : staticObjects)
+		// Updates say if they are differences from the baseline. The server only sends them for objects we were sent in it
+		bool isDelta;
+		if (!bsIn.Read(isDelta))
+		{
+			return;
+		}
+		const QuantizedState* baselineState = nullptr;
+		if (isDelta && baseline)
+		{
+			auto found = std::lower_bound(baseline->states.begin(), baseline->states.end(), id, [](const std::pair<unsigned int, QuantizedState>& state, unsigned int id)
 			{
-				CollisionSystem::handleCollision(gameObj, staticObj, true);
-			}
-			// Other game objects
-			for (auto& otherGameObjIt = std::next(gameObjIt); otherGameObjIt != gameObjects.end(); otherGameObjIt++)
+				return state.first < id;
+			});
+			if (found != baseline->states.end() && found->first == id)
 			{
-				CollisionSystem::handleCollision(gameObj, otherGameObjIt->second, true);
+				baselineState = &found->second;
 			}
+		}
 
-			// Our client object
-			if (myClientObject)
-			{
-				CollisionSystem::handleCollision(gameObj, myClientObject, true);
-			}
+		if (isDelta && !baselineState)
+		{
+			return;
 		}
 
-		// Static objects with our client object
-		if (myClientObject)
+		QuantizedState quantized;
+		PhysicsState state;
+		bool isAwake;
+		bool isRead = baselineState ? stateQuantizer.readDelta(bsIn, *baselineState, quantized) : stateQuantizer.read(bsIn, quantized);
+		if (!isRead || !bsIn.Read(isAwake) || !stateQuantizer.dequantize(quantized, state))
 		{
-			for (auto& staticObj : staticObjects)
-			{
-				CollisionSystem::handleCollision(myClientObject, staticObj, true);
-			}
+			return;
+		}
+
+		if (isCollecting)
+		{
+			collectingSnapshot.states.push_back({ id, quantized });
 		}
+		applyObjectState(id, state, isAwake, timeStamp);
+	}
+
+	// Once every packet of a snapshot has arrived, keep it as a baseline and acknowledge it with the next input
+	bool isLastPacket;
+	if (!isCollecting || !bsIn.Read(isLastPacket))
+	{
+		return;
+	}
+	collectingPackets++;
+	if (isLastPacket)
+	{
+		collectingPacketCount = packetIndex + 1;
+	}
+
+	if (collectingPacketCount != 0 && collectingPackets == collectingPacketCount)
+	{
+		std::sort(collectingSnapshot.states.begin(), collectingSnapshot.states.end(), [](const std::pair<unsigned int, QuantizedState>& a, const std::pair<unsigned int, QuantizedState>& b)
+		{
+			return a.first < b.first;
+		});
+		std::swap(receivedSnapshots[sequence % receivedSnapshotCount], collectingSnapshot);
+		ackedSnapshot = sequence;
+
+		// Any more packets for this snapshot would be duplicates
+		collectingSnapshot.sequence = sequence + 1;
+		collectingSnapshot.states.clear();
+		collectingPackets = 0;
+		collectingPacketCount = 0;
+	}
+}
+
+
+void Client::updateStaticWorld()
+{
+	// Static objects can be split over multiple packets, so the static world is built when it is next needed
+	if (broadphase.getStaticWorld().getSourceCount() != staticObjects.size())
+	{
+		broadphase.buildStaticWorld(staticObjects);
 	}
+}
+
+
+void Client::systemUpdate()
+{
+	RakNet::Time currentTime = RakNet::GetTime();
+	float deltaTime = (currentTime - lastUpdateTime) * 0.001f;
+
+
+	// Predict collisions between game objects, static objects, and our client object
+	updateStaticWorld();
+	broadphase.updateObjects(deltaTime);
+	broadphase.findPairs([](GameObject* object1, StaticObject* object2)
+	{
+		CollisionSystem::handleCollision(object1, object2, true);
+	});
 	
 
 	// Update our client object, get input, send it to the server, and predict it localy
@@ -326,6 +502,8 @@ void Client::systemUpdate()
 		bs.Write(currentTime);
 		bs.Write((RakNet::MessageID)ID_CLIENT_INPUT);
 		bs.Write(input);
+		// Let the server know the latest snapshot we have all of, so it can send differences from it
+		bs.Write(ackedSnapshot);
 		// Send input to the server
 		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
 
@@ -339,10 +517,7 @@ void Client::systemUpdate()
 	
 
 	// Update the game objects. This is dead reckoning
-	for (auto& it : gameObjects)
-	{
-		it.second->physicsStep(deltaTime);
-	}
+	gameObjects.integrate(deltaTime);
 
 	lastUpdateTime = currentTime;
 }
@@ -402,6 +577,10 @@ void Client::processSystemMessage(const RakNet::Packet* packet)
 		// This packet is sent with a timestamp, which we already got
 		applyServerUpdate(bsIn, time);
 		break;
+	case ID_SERVER_SNAPSHOT:
+		// Note: awake objects are sent unreliably, and sleeping objects reliably, both in channel 1
+		applySnapshot(bsIn, time);
+		break;
 
 
 	default:
@@ -3,8 +3,9 @@
 #include <RakPeerInterface.h>
 #include "../Shared/ClientObject.h"
 #include "../Shared/RingBuffer.h"
+#include "../Shared/Broadphase.h"
+#include "../Shared/StateQuantizer.h"
 #include <vector>
-#include <unordered_map>
 
 
 /// <summary>
@@ -17,6 +18,21 @@ public:
 	Client();
 	virtual ~Client();
 
+
+	// Spatial queries against the clients copy of the world, such as for predicting hitscan weapons
+
+	// Find the closest object hit by a ray. Returns true if something was hit
+	bool raycast(const RaycastQuery& ray, QueryHit& hitOut) const { return broadphase.raycast(ray, hitOut); }
+	// Find the closest object hit by each ray. Rays that hit nothing have a null object
+	void raycastBatch(const std::vector<RaycastQuery>& rays, std::vector<QueryHit>& hitsOut) const { broadphase.raycastBatch(rays, hitsOut); }
+	// Find the first object hit by a shape moving along a ray. Returns true if something was hit
+	bool shapeCast(const Collider& shape, const raylib::Vector3& rotation, const RaycastQuery& path, QueryHit& hitOut) const { return broadphase.shapeCast(shape, rotation, path, hitOut); }
+	// Add every object overlapping a shape to objectsOut
+	void overlap(const Collider& shape, const raylib::Vector3& position, const raylib::Vector3& rotation, std::vector<StaticObject*>& objectsOut, unsigned int mask = 0xFFFFFFFF) const
+	{
+		broadphase.overlap(shape, position, rotation, objectsOut, mask);
+	}
+
 protected:
 	// THESE FUNCTIONS ARE FOR THE USER TO USE WITHIN THE CLIENT CLASS
 
@@ -36,6 +52,10 @@ protected:
 		// The objects collider, or null pointer if it doesnt have one
 		Collider* collider = nullptr;
 		float mass = 1, elasticity = 1, friction = 1;
+		// Set on the object by the system after it is created
+		unsigned int collisionCategory = 1, collisionMask = 0xFFFFFFFF;
+		// Should the object be created asleep? Only used by game objects
+		bool isAwake = true;
 	};
 	
 	/// <summary>
@@ -85,6 +105,13 @@ private:
 
 	// Used when an object update is receved from the server
 	void applyServerUpdate(RakNet::BitStream& bsIn, const RakNet::Time& timeStamp);
+	// Used when a snapshot packet is receved from the server, applying every update in it, and keeping it as a baseline once all of it has arrived
+	void applySnapshot(RakNet::BitStream& bsIn, const RakNet::Time& timeStamp);
+	// Apply a physics state from the server to the object with the ID
+	void applyObjectState(unsigned int id, const PhysicsState& state, bool isAwake, const RakNet::Time& timeStamp);
+
+	// Build the static world if static objects have been receved since it was last built
+	void updateStaticWorld();
 
 
 
@@ -93,12 +120,15 @@ protected:
 
 	// Static objects are receved from the server after connecting
 	std::vector<StaticObject*> staticObjects;
-	// All game objects. This includes other players client objects
-	// <object ID, game object>
-	std::unordered_map<unsigned int, GameObject*> gameObjects;
-	// The object owned by this client
+	// All game objects, with their physics state stored together. This includes other players client objects.
+	// Uses the IDs given out by the server
+	BodyStorage gameObjects;
+	// The object owned by this client. Not in gameObjects, since it is stepped by input
 	ClientObject* myClientObject;
 
+	// Decides how precisely object updates are read for each object type. Needs the same profiles as the server, in the same order
+	StateQuantizer stateQuantizer;
+
 private:
 	// The ID assigned to this client by the server
 	// The user should not be able to change this, so give them a getter
@@ -112,4 +142,25 @@ private:
 
 	// Object IDs that have been destroied, but not created. Caused by latency variance
 	std::vector<unsigned int> objectIDBlacklist;
+	// Object IDs replaced by a newer generation in the same slot before their destroy arrived. The destroy is ignored when it does
+	std::vector<unsigned int> replacedObjectIDs;
+
+	// Used to find pairs of objects that might be colliding for prediction
+	Broadphase broadphase;
+
+	// The quantized states of awake objects in a snapshot, sorted by ID
+	struct ReceivedSnapshot
+	{
+		unsigned int sequence = 0;
+		std::vector<std::pair<unsigned int, QuantizedState>> states;
+	};
+	// The last few snapshots that fully arrived, indexed by sequence. The server sends updates as differences from them
+	static const unsigned int receivedSnapshotCount = 64;
+	std::vector<ReceivedSnapshot> receivedSnapshots;
+	// The snapshot whose packets are arriving, how many have arrived, and how many there are once the last has arrived
+	ReceivedSnapshot collectingSnapshot;
+	unsigned int collectingPackets = 0;
+	unsigned int collectingPacketCount = 0;
+	// The latest snapshot that fully arrived. Sent with input
+	unsigned int ackedSnapshot = 0;
 };
\ No newline at end of file
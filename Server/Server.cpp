@@ -2,17 +2,22 @@
 #include <GetTime.h>
 #include "../Shared/GameMessages.h"
 #include "../Shared/CollisionSystem.h"
+#include <algorithm>
 
 
-Server::Server(float timeStep) :
-	timeStep(timeStep)
+Server::Server(float timeStep, int workerCount) :
+	timeStep(timeStep), tickGovernor(timeStep), jobSystem(workerCount < 0 ? JobSystem::getDefaultWorkerCount() : workerCount),
+	isNetworkThreadRunning(false), isSnapshotReady(false)
 {
 	peerInterface = RakNet::RakPeerInterface::GetInstance();
 	lastUpdateTime = RakNet::GetTime();
+	sentSnapshots.resize(sentSnapshotCount);
 }
 
 Server::~Server()
 {
+	// The network thread uses the peer interface, so it needs to stop first
+	stopNetworkThread();
 	RakNet::RakPeerInterface::DestroyInstance(peerInterface);
 
 
@@ -22,17 +27,20 @@ Server::~Server()
 	}
 	staticObjects.clear();
 
-	for (auto& it : gameObjects)
+	// Take each object out of its storage before deleting it. Removing the last one doesnt move anything
+	while (!gameObjects.empty())
 	{
-		delete it.second;
+		GameObject* object = gameObjects.getObject(gameObjects.size() - 1);
+		gameObjects.remove(object);
+		delete object;
 	}
-	gameObjects.clear();
-
-	for (auto& it : clientObjects)
+	while (!clientObjects.empty())
 	{
-		delete it.second;
+		GameObject* object = clientObjects.getObject(clientObjects.size() - 1);
+		clientObjects.remove(object);
+		delete object;
 	}
-	clientObjects.clear();
+	objectIDs.clear();
 
 	addressToClientID.clear();
 }
@@ -44,11 +52,12 @@ void Server::createObject(unsigned int typeID, const PhysicsState& state, const
 	float deltaTime = (RakNet::GetTime() - creationTime) * 0.001f;
 	PhysicsState newState(state);
 	newState.position += newState.velocity * deltaTime;
-	newState.rotation += newState.angularVelocity * deltaTime;
+	newState.rotation = GameObject::integrateRotation(newState.rotation, newState.angularVelocity, deltaTime);
 
 	// Use factory method to create new object, checking it was created correctly
-	GameObject* obj = gameObjectFactory(typeID, nextObjectID, newState, *customParamiters);
-	if (!obj || obj->getID() != nextObjectID)
+	unsigned int objectID = objectIDs.getNextID();
+	GameObject* obj = gameObjectFactory(typeID, objectID, newState, *customParamiters);
+	if (!obj || obj->getID() != objectID)
 	{
 		if (obj)
 		{
@@ -61,20 +70,24 @@ void Server::createObject(unsigned int typeID, const PhysicsState& state, const
 	}
 
 
-	// Send reliable message to clients for them to create the object
-	RakNet::BitStream bs;
-	bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
-	obj->serialize(bs);
-	peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+	// Send reliable message to clients for them to create the object. With interest management, clients are sent it once they are near it
+	if (interestRadius < 0)
+	{
+		RakNet::BitStream bs;
+		bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
+		obj->serialize(bs);
+		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+	}
 
-	gameObjects[nextObjectID] = obj;
-	nextObjectID++;
+	objectIDs.insert(objectID);
+	gameObjects.add(obj);
+	broadphase.addObject(obj);
 }
 
 void Server::destroyObject(unsigned int objectID)
 {
 	// Only destroy game objects
-	if (objectID < nextClientID)
+	if (!gameObjects.contains(objectID))
 	{
 		return;
 	}
@@ -141,104 +154,198 @@ void Server::processSystemMessage(const RakNet::Packet* packet)
 
 void Server::systemUpdate()
 {
-	// Use static to keep value between calls
-	static float accumulatedTime = 0.0f;
+	// Process packets the network thread has received since the last update
+	if (isNetworkThreaded())
+	{
+		RakNet::Packet* packet;
+		while (receivedPackets.pop(packet))
+		{
+			processSystemMessage(packet);
+			processGameMessage(packet);
+			peerInterface->DeallocatePacket(packet);
+		}
+	}
 
 	RakNet::Time currentTime = RakNet::GetTime();
-	accumulatedTime += (currentTime - lastUpdateTime) * 0.001f;
+	tickGovernor.beginUpdate((currentTime - lastUpdateTime) * 0.001f);
 
-	// Fixed time step for physics
-	while (accumulatedTime >= timeStep)
+	// Fixed time step for physics. The governor limits how many steps are run, so a slow update doesnt make the next one slower
+	while (tickGovernor.shouldStep())
 	{
+		// When overloaded, resting objects fall asleep straight away so they stop being checked for collisions.
+		// Only objects touching something last step, as gravity stops while asleep and would leave falling objects in the air
+		if (tickGovernor.getOverloadLevel() >= TickGovernor::EarlySleep)
+		{
+			for (GameObject* object : gameObjects)
+			{
+				if (object->getLastContactSolve() == contactSolver.getSolveCount())
+				{
+					object->sleepIfResting();
+				}
+			}
+		}
+
 		collisionDetectionAndResolution();
 
-		// Update game objects, sending updates to clients
-		for (auto& it : gameObjects)
+		// Remember where fast objects start, so their path can be checked after they move
+		sweptObjects.clear();
+		for (GameObject* object : gameObjects)
 		{
-			it.second->physicsStep(timeStep);
+			bool isFast = ccdSpeedThreshold >= 0 && Vector3LengthSqr(object->getVelocity()) > ccdSpeedThreshold * ccdSpeedThreshold;
+			if (object->isAwake() && object->getCollider() && (object->usesContinuousCollision() || isFast))
+			{
+				sweptObjects.push_back({ object, object->getPosition() });
+			}
 		}
 
+		// Update game objects, splitting the work between the job systems threads
+		gameObjects.integrate(timeStep, &jobSystem);
+		sweepFastObjects();
+
 		// Destroy objects
 		for (auto id : deadObjects)
 		{
-			if (gameObjects.count(id) > 0)	// Make sure the object still exists
+			GameObject* object = gameObjects.find(id);
+			if (object)	// Make sure the object still exists
 			{
 				// Send message to clients
-				RakNet::BitStream bs;
-				bs.Write((RakNet::MessageID)ID_SERVER_DESTROY_GAME_OBJECT);
-				bs.Write(id);
-				peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+				sendDestroyObject(id);
+
+				// Wake anything touching the object, since it might have been resting on it
+				broadphase.query(object->getAABB(), [](StaticObject* other)
+				{
+					if (!other->isStatic())
+					{
+						static_cast<GameObject*>(other)->wake();
+					}
+				});
 
 				// Delete the object
-				delete gameObjects[id];
-				gameObjects.erase(id);
+				broadphase.removeObject(object);
+				transformHistory.forget(object);
+				sleepingObjects.erase(id);
+				gameObjects.remove(object);
+				objectIDs.remove(id);
+				delete object;
 			}
 		}
 		deadObjects.clear();
 
 
-		// Reduce time
-		accumulatedTime -= timeStep;
+		tickGovernor.endStep();
 	}
 
+	// Remember where everything is, matching the time stamp sent with the updates below
+	transformHistory.record(currentTime, gameObjects, clientObjects);
+
 
-	// Send updated states
-	for (auto& it : gameObjects)
+	// Send updated states, handing them to the network thread if it is running
+	if (isNetworkThreaded())
+	{
+		publishSnapshot(currentTime);
+	}
+	else
 	{
-		sendGameObjectUpdate(it.second, currentTime);
+		collectUpdates(snapshots[0], currentTime);
+		sendSnapshot(snapshots[0]);
 	}
 
 	// Update time now that this update is over
 	lastUpdateTime = currentTime;
+	tickGovernor.endUpdate();
+}
+
+TransformHistory::RewindScope Server::rewind(RakNet::Time time, const std::vector<GameObject*>& objects)
+{
+	// Dont let clients rewind further than allowed
+	RakNet::Time oldestAllowed = lastUpdateTime > maxRewindTime ? lastUpdateTime - maxRewindTime : 0;
+	if (time < oldestAllowed)
+	{
+		time = oldestAllowed;
+	}
+
+	return transformHistory.rewind(time, objects, broadphase);
 }
 
 void Server::collisionDetectionAndResolution()
 {
-	// Game objects with static, client, and other game objects
-	for (auto& gameObjIt = gameObjects.begin(); gameObjIt != gameObjects.end(); gameObjIt++)
+	// Static objects are created after the constructor, so build the static world during the first update
+	if (broadphase.getStaticWorld().getSourceCount() != staticObjects.size())
 	{
-		GameObject* gameObj = gameObjIt->second;
-		
-		// Static objects
-		for (auto& staticObj : staticObjects)
-		{
-			CollisionSystem::handleCollision(gameObj, staticObj, true);
-		}
-		// Other game objects
-		for (auto& otherGameObjIt = std::next(gameObjIt); otherGameObjIt != gameObjects.end(); otherGameObjIt++)
+		broadphase.buildStaticWorld(staticObjects);
+	}
+
+	// Refit objects that have moved, then find contacts for every pair that might be colliding
+	broadphase.updateObjects(timeStep);
+	contacts.clear();
+	if (useParallelNarrowphase)
+	{
+		// Collect every pair first, so they can be checked on multiple threads
+		collisionPairs.clear();
+		broadphase.findPairs([this](GameObject* object1, StaticObject* object2)
 		{
-			CollisionSystem::handleCollision(gameObj, otherGameObjIt->second, true);
-		}
-		// Client objects
-		for (auto& clientObjIt = clientObjects.begin(); clientObjIt != clientObjects.end(); clientObjIt++)
+			collisionPairs.push_back({ object1, object2 });
+		});
+		CollisionSystem::checkCollisions(collisionPairs, contacts, jobSystem);
+	}
+	else
+	{
+		broadphase.findPairs([this](GameObject* object1, StaticObject* object2)
 		{
-			CollisionSystem::handleCollision(gameObj, clientObjIt->second, true);
-		}
+			Contact contact;
+			if (CollisionSystem::checkCollision(object1, object2, true, contact))
+			{
+				contacts.push_back(contact);
+			}
+		});
 	}
 
-	// Client objects with static and other client objects
-	for (auto& clientObjIt = clientObjects.begin(); clientObjIt != clientObjects.end(); clientObjIt++)
+	// Resolve contacts in islands of touching objects, using the job system
+	contactSolver.solve(contacts, jobSystem, solverIterations);
+}
+
+void Server::sweepFastObjects()
+{
+	// Objects are swept one at a time in ID order, so each sees the others where they ended up
+	std::sort(sweptObjects.begin(), sweptObjects.end(), [](const std::pair<GameObject*, raylib::Vector3>& a, const std::pair<GameObject*, raylib::Vector3>& b)
 	{
-		GameObject* gameObj = clientObjIt->second;
+		return a.first->getID() < b.first->getID();
+	});
 
-		// Static objects
-		for (auto& staticObj : staticObjects)
+	for (auto& swept : sweptObjects)
+	{
+		GameObject* object = swept.first;
+		const raylib::Vector3& start = swept.second;
+		raylib::Vector3 path = Vector3Subtract(object->getPosition(), start);
+
+		// Objects moving less than their inner radius can not pass through anything, so normal collision detection is enough
+		if (Vector3Length(path) <= object->getCollider()->getInnerRadius())
 		{
-			CollisionSystem::handleCollision(gameObj, staticObj, true);
+			continue;
 		}
-		// Other client objects
-		for (auto& otherClientObjIt = std::next(clientObjIt); otherClientObjIt != clientObjects.end(); otherClientObjIt++)
+
+		// Anything in the box covering the whole path could be in the way
+		AABB endAABB = object->getAABB();
+		AABB sweptAABB = AABB::combine(endAABB, AABB(Vector3Subtract(endAABB.lower, path), Vector3Subtract(endAABB.upper, path)));
+		sweepCandidates.clear();
+		broadphase.query(sweptAABB, [this](StaticObject* other)
 		{
-			CollisionSystem::handleCollision(gameObj, otherClientObjIt->second, true);
-		}
+			sweepCandidates.push_back(other);
+		});
+
+		CollisionSystem::sweepObject(object, start, sweepCandidates);
 	}
 }
 
 
 void Server::onClientConnect(const RakNet::SystemAddress& connectedAddress)
 {
-	// Add client to map
-	addressToClientID[RakNet::SystemAddress::ToInteger(connectedAddress)] = nextClientID;
+	// Client objects get their IDs from the same slot map as game objects, so they never clash
+	unsigned int clientID = objectIDs.getNextID();
+
+	// Add client to map. It has no snapshots to use as a baseline yet
+	addressToClientID[RakNet::SystemAddress::ToInteger(connectedAddress)] = clientID;
+	snapshotClients[clientID] = { clientID, connectedAddress, 0 };
 
 
 	// Send static objects
@@ -263,26 +370,29 @@ void Server::onClientConnect(const RakNet::SystemAddress& connectedAddress)
 	}
 
 
-	// Send existing game and client objects
-	for (auto& it : gameObjects)
+	// Send existing game and client objects. With interest management, only nearby objects are sent, once the client object exists
+	if (interestRadius < 0)
 	{
-		RakNet::BitStream bs;
-		bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
-		it.second->serialize(bs);
-		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, connectedAddress, false);
-	}
-	for (auto& it : clientObjects)
-	{
-		RakNet::BitStream bs;
-		bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
-		it.second->serialize(bs);
-		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, connectedAddress, false);
+		for (GameObject* object : gameObjects)
+		{
+			RakNet::BitStream bs;
+			bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
+			object->serialize(bs);
+			peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, connectedAddress, false);
+		}
+		for (GameObject* object : clientObjects)
+		{
+			RakNet::BitStream bs;
+			bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
+			object->serialize(bs);
+			peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, connectedAddress, false);
+		}
 	}
 
 
 	// Create client object and add it to the map
-	ClientObject* clientObject = clientObjectFactory(nextClientID);
-	if (!clientObject ||  clientObject->getID() != nextClientID)
+	ClientObject* clientObject = clientObjectFactory(clientID);
+	if (!clientObject ||  clientObject->getID() != clientID)
 	{
 		if (clientObject)
 		{
@@ -290,10 +400,12 @@ void Server::onClientConnect(const RakNet::SystemAddress& connectedAddress)
 		}
 
 		// Throw a descriptive error
-		std::string str = "Error creating client object for clientID " + std::to_string(nextClientID);
+		std::string str = "Error creating client object for clientID " + std::to_string(clientID);
 		throw new std::exception(str.c_str());
 	}
-	clientObjects[nextClientID] = clientObject;
+	objectIDs.insert(clientID);
+	clientObjects.add(clientObject);
+	broadphase.addObject(clientObject);
 	// Send client object to client
 	{
 		RakNet::BitStream bs;
@@ -301,16 +413,14 @@ void Server::onClientConnect(const RakNet::SystemAddress& connectedAddress)
 		clientObject->serialize(bs);
 		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, connectedAddress, false);
 	}
-	// Send game object to all other clients
+	// Send game object to all other clients. With interest management, only clients near it are sent it
+	if (interestRadius < 0)
 	{
 		RakNet::BitStream bs;
 		bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
 		clientObject->serialize(bs);
 		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, connectedAddress, true);
 	}
-
-
-	nextClientID++;
 }
 
 void Server::onClientDisconnect(const RakNet::SystemAddress& disconnectedAddress)
@@ -318,24 +428,38 @@ void Server::onClientDisconnect(const RakNet::SystemAddress& disconnectedAddress
 	unsigned int id = addressToClientID[RakNet::SystemAddress::ToInteger(disconnectedAddress)];
 
 	// Send message to all clients to destroy the disconnected clients object
-	RakNet::BitStream bs;
-	bs.Write((RakNet::MessageID)ID_SERVER_DESTROY_GAME_OBJECT);
-	bs.Write(id);
-	peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+	sendDestroyObject(id);
 
 	// Remove the client object and its address from the map
-	clientObjects.erase(id);
+	GameObject* clientObject = clientObjects.find(id);
+	if (clientObject)
+	{
+		broadphase.removeObject(clientObject);
+		transformHistory.forget(clientObject);
+		clientObjects.remove(clientObject);
+		objectIDs.remove(id);
+	}
 	addressToClientID.erase(RakNet::SystemAddress::ToInteger(disconnectedAddress));
+	snapshotClients.erase(id);
+	visibleObjects.erase(id);
 }
 
 
 void Server::processInput(unsigned int clientID, RakNet::BitStream& bsIn, const RakNet::Time& timeStamp)
 {
-	ClientObject* clientObject = clientObjects[clientID];
+	ClientObject* clientObject = static_cast<ClientObject*>(clientObjects.find(clientID));
 	// Get the input struct. Input is defined in ClientObject.h
 	Input input;
 	bsIn.Read(input);
 
+	// Input also carries the latest snapshot the client has received all of. Input can arrive out of order, so only move forward
+	unsigned int ackedSnapshot = 0;
+	auto snapshotClient = snapshotClients.find(clientID);
+	if (bsIn.Read(ackedSnapshot) && snapshotClient != snapshotClients.end() && ackedSnapshot > snapshotClient->second.baselineSequence)
+	{
+		snapshotClient->second.baselineSequence = ackedSnapshot;
+	}
+
 
 	// Action inputs can always be used, since they dont affect physics state
 	clientObject->processInputAction(input, timeStamp);
@@ -365,6 +489,11 @@ void Server::processInput(unsigned int clientID, RakNet::BitStream& bsIn, const
 
 
 void Server::sendGameObjectUpdate(GameObject* object, RakNet::Time timeStamp)
+{
+	sendObjectUpdate({ object->getID(), object->getTypeID(), object->getPosition(), object->getOrientation(), object->getVelocity(), object->getAngularVelocity(), object->isAwake() }, timeStamp);
+}
+
+void Server::sendObjectUpdate(const ObjectUpdate& update, RakNet::Time timeStamp)
 {
 	RakNet::BitStream bs;
 
@@ -373,12 +502,547 @@ void Server::sendGameObjectUpdate(GameObject* object, RakNet::Time timeStamp)
 	bs.Write(timeStamp);
 
 	bs.Write((RakNet::MessageID)ID_SERVER_UPDATE_GAME_OBJECT);
-	bs.Write(object->getID());
-	bs.Write(object->getPosition());
-	bs.Write(object->getRotation());
-	bs.Write(object->getVelocity());
-	bs.Write(object->getAngularVelocity());
-
-	// Send the packet to all clients. It is not garenteed to arrive, but are sent often
-	peerInterface->Send(&bs, MEDIUM_PRIORITY, UNRELIABLE, 1, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+	writeObjectUpdate(bs, update);
+
+	// Send the packet to all clients. Updates for awake objects are not garenteed to arrive, but are sent often.
+	// Sleeping objects stop sending updates, so their last one needs to be reliable
+	PacketReliability reliability = update.isAwake ? UNRELIABLE : RELIABLE;
+	if (interestRadius < 0)
+	{
+		peerInterface->Send(&bs, MEDIUM_PRIORITY, reliability, 1, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+		return;
+	}
+
+	// With interest management, only send it to clients that can see the object, and the client that owns it
+	for (auto& it : snapshotClients)
+	{
+		auto visible = visibleObjects.find(it.first);
+		if (it.first == update.id || (visible != visibleObjects.end() && visible->second.count(update.id) != 0))
+		{
+			peerInterface->Send(&bs, MEDIUM_PRIORITY, reliability, 1, it.second.address, false);
+		}
+	}
+}
+
+void Server::sendDestroyObject(unsigned int objectID)
+{
+	RakNet::BitStream bs;
+	bs.Write((RakNet::MessageID)ID_SERVER_DESTROY_GAME_OBJECT);
+	bs.Write(objectID);
+
+	if (interestRadius < 0)
+	{
+		peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+		return;
+	}
+
+	// Only clients that were sent the object need to destroy it. Ordered with the message creating it, so it cant arrive first
+	for (auto& it : snapshotClients)
+	{
+		auto visible = visibleObjects.find(it.first);
+		if (visible != visibleObjects.end() && visible->second.erase(objectID) != 0)
+		{
+			peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE_ORDERED, 0, it.second.address, false);
+		}
+	}
+}
+
+
+void Server::startNetworkThread()
+{
+	if (isNetworkThreaded())
+	{
+		return;
+	}
+
+	isSnapshotReady.store(false);
+	isNetworkThreadRunning.store(true);
+	networkThread = std::thread(&Server::networkLoop, this);
+}
+
+void Server::stopNetworkThread()
+{
+	if (!isNetworkThreaded())
+	{
+		return;
+	}
+
+	isNetworkThreadRunning.store(false);
+	networkThread.join();
+
+	// Packets that were never processed still need to be given back to raknet
+	RakNet::Packet* packet;
+	while (receivedPackets.pop(packet))
+	{
+		peerInterface->DeallocatePacket(packet);
+	}
+
+	// A snapshot published but not yet taken still needs sending. Its sleeping objects have been marked as sent, so their last update would never arrive
+	if (isSnapshotReady.load(std::memory_order_acquire))
+	{
+		sendSnapshot(snapshots[readSnapshot]);
+		isSnapshotReady.store(false);
+	}
+}
+
+void Server::collectUpdates(UpdateSnapshot& snapshot, RakNet::Time timeStamp)
+{
+	snapshot.time = timeStamp;
+	snapshot.sequence = nextSnapshotSequence++;
+	snapshot.updates.clear();
+
+	// Copy each client and the last snapshot it acknowledged, since acknowledgements keep arriving while the snapshot is sent
+	snapshot.isFiltered = interestRadius >= 0;
+	snapshot.clients.clear();
+	interestClients.clear();
+	for (auto& it : snapshotClients)
+	{
+		snapshot.clients.push_back(it.second);
+		GameObject* clientObject = clientObjects.find(it.first);
+		if (clientObject)
+		{
+			snapshot.clients.back().position = clientObject->getPosition();
+		}
+		if (snapshot.isFiltered)
+		{
+			interestClients.push_back({ it.first, &visibleObjects[it.first] });
+		}
+	}
+
+	// Sleeping objects only send one last update when they fall asleep. When overloaded, awake objects skip some updates
+	bool shouldSendAwake = tickGovernor.shouldSendUpdates();
+	for (GameObject* object : gameObjects)
+	{
+		bool shouldSend = false;
+		if (object->isAwake())
+		{
+			sleepingObjects.erase(object->getID());
+			shouldSend = shouldSendAwake;
+		}
+		else
+		{
+			shouldSend = sleepingObjects.insert(object->getID()).second;
+		}
+
+		if (shouldSend)
+		{
+			snapshot.updates.push_back({ object->getID(), object->getTypeID(), object->getPosition(), object->getOrientation(), object->getVelocity(), object->getAngularVelocity(), object->isAwake() });
+		}
+	}
+
+	if (snapshot.isFiltered)
+	{
+		updateInterest(snapshot);
+	}
+}
+
+void Server::updateInterest(UpdateSnapshot& snapshot)
+{
+	// Cells as wide as the search radius mean each client only searches the cells around its own
+	float leaveRadius = interestRadius + (interestHysteresis > 0 ? interestHysteresis : 0);
+	interestGrid.clear();
+	interestGrid.setCellSize(leaveRadius > 1 ? leaveRadius : 1);
+	for (GameObject* object : gameObjects)
+	{
+		interestGrid.add(object);
+	}
+	for (GameObject* object : clientObjects)
+	{
+		interestGrid.add(object);
+	}
+	interestGrid.build();
+
+	updateIndices.clear();
+	for (size_t i = 0; i < snapshot.updates.size(); i++)
+	{
+		updateIndices[snapshot.updates[i].id] = (unsigned int)i;
+	}
+
+	// Each client only changes its own visible objects, so clients can be updated on seperate threads
+	unsigned int sequence = snapshot.sequence;
+	float enterRadiusSqr = interestRadius * interestRadius;
+	snapshot.visibleUpdates.resize(snapshot.clients.size());
+	jobSystem.parallelFor(interestClients.size(), [&](size_t i)
+	{
+		unsigned int clientID = interestClients[i].first;
+		std::unordered_map<unsigned int, VisibleObject>& visible = *interestClients[i].second;
+		const RakNet::SystemAddress& address = snapshot.clients[i].address;
+
+		// Mark objects that are still in range, and create objects that have come into range.
+		// Creation and destruction messages are ordered, so an object leaving and coming back is never created twice
+		GameObject* clientObject = clientObjects.find(clientID);
+		if (clientObject)
+		{
+			interestGrid.query(clientObject->getPosition(), leaveRadius, [&](GameObject* object, float distanceSqr)
+			{
+				unsigned int id = object->getID();
+				if (id == clientID)
+				{
+					return;
+				}
+
+				auto found = visible.find(id);
+				if (found != visible.end())
+				{
+					found->second.seenSequence = sequence;
+				}
+				else if (distanceSqr <= enterRadiusSqr)
+				{
+					visible[id] = { sequence, sequence };
+
+					RakNet::BitStream bs;
+					bs.Write((RakNet::MessageID)ID_SERVER_CREATE_GAME_OBJECT);
+					object->serialize(bs);
+					peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE_ORDERED, 0, address, false);
+				}
+			});
+		}
+
+		// Objects that werent found have gone out of range, and the rest are sent their updates
+		std::vector<VisibleUpdate>& updates = snapshot.visibleUpdates[i];
+		updates.clear();
+		for (auto it = visible.begin(); it != visible.end();)
+		{
+			if (it->second.seenSequence != sequence)
+			{
+				RakNet::BitStream bs;
+				bs.Write((RakNet::MessageID)ID_SERVER_DESTROY_GAME_OBJECT);
+				bs.Write(it->first);
+				peerInterface->Send(&bs, HIGH_PRIORITY, RELIABLE_ORDERED, 0, address, false);
+
+				it = visible.erase(it);
+				continue;
+			}
+
+			auto update = updateIndices.find(it->first);
+			if (update != updateIndices.end())
+			{
+				updates.push_back({ update->second, it->second.visibleSequence });
+			}
+			++it;
+		}
+	});
+}
+
+void Server::writeObjectUpdate(RakNet::BitStream& bs, const ObjectUpdate& update) const
+{
+	bs.Write(update.id);
+	stateQuantizer.write(bs, update.typeID, update.position, update.rotation, update.velocity, update.angularVelocity);
+	bs.Write(update.isAwake);
+}
+
+void Server::sendSnapshot(UpdateSnapshot& snapshot)
+{
+	size_t count = snapshot.updates.size();
+	snapshot.states.resize(count);
+	jobSystem.parallelForRange(count, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const ObjectUpdate& update = snapshot.updates[i];
+			snapshot.states[i] = stateQuantizer.quantize(update.typeID, update.position, update.rotation, update.velocity, update.angularVelocity);
+		}
+	}, 256);
+
+	// The last update before sleeping needs to arrive, so it is sent reliably and in full, since a reliable packet can arrive after its baseline is gone
+	if (!snapshot.isFiltered)
+	{
+		sendSnapshotPackets(snapshot, false, nullptr, nullptr, -1, RakNet::UNASSIGNED_SYSTEM_ADDRESS);
+	}
+
+	// Remember what was sent to every client, so it can be used as a baseline once a client acknowledges it
+	SentSnapshot& sent = sentSnapshots[snapshot.sequence % sentSnapshotCount];
+	sent.sequence = snapshot.sequence;
+	sent.states.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		if (snapshot.updates[i].isAwake)
+		{
+			sent.states.push_back({ snapshot.updates[i].id, snapshot.states[i] });
+		}
+	}
+	std::sort(sent.states.begin(), sent.states.end(), [](const std::pair<unsigned int, QuantizedState>& a, const std::pair<unsigned int, QuantizedState>& b)
+	{
+		return a.first < b.first;
+	});
+
+	// Find the priorities of each client, forgetting clients that have disconnected
+	if (snapshotBudget >= 0)
+	{
+		priorityClients.clear();
+		for (const SnapshotClient& client : snapshot.clients)
+		{
+			priorityClients.push_back(&clientPriorities[client.clientID]);
+		}
+		for (auto it = clientPriorities.begin(); it != clientPriorities.end();)
+		{
+			bool isConnected = std::any_of(snapshot.clients.begin(), snapshot.clients.end(), [&](const SnapshotClient& client) { return client.clientID == it->first; });
+			it = isConnected ? std::next(it) : clientPriorities.erase(it);
+		}
+	}
+
+	// Awake objects are sent unreliably to each client, as differences from the last snapshot it received all of.
+	// A lost packet only means the next snapshot is sent as differences from an older one
+	jobSystem.parallelFor(snapshot.clients.size(), [&](size_t i)
+	{
+		const SnapshotClient& client = snapshot.clients[i];
+		const SentSnapshot& baseline = sentSnapshots[client.baselineSequence % sentSnapshotCount];
+		bool hasBaseline = client.baselineSequence != 0 && baseline.sequence == client.baselineSequence;
+
+		// With interest management, each client is only sent the objects it can see, including the last updates of sleeping objects
+		const std::vector<VisibleUpdate>* visibleUpdates = snapshot.isFiltered ? &snapshot.visibleUpdates[i] : nullptr;
+		if (visibleUpdates)
+		{
+			sendSnapshotPackets(snapshot, false, nullptr, visibleUpdates, -1, client.address);
+		}
+
+		if (snapshotBudget >= 0)
+		{
+			sendPrioritisedUpdates(snapshot, client, hasBaseline ? &baseline : nullptr, visibleUpdates, *priorityClients[i]);
+		}
+		else
+		{
+			sendSnapshotPackets(snapshot, true, hasBaseline ? &baseline : nullptr, visibleUpdates, -1, client.address);
+		}
+	});
+}
+
+void Server::sendPrioritisedUpdates(const UpdateSnapshot& snapshot, const SnapshotClient& client, const SentSnapshot* baseline, const std::vector<VisibleUpdate>* visibleUpdates, ClientPriorities& priorities)
+{
+	// Every awake update the client can see gains priority, faster for objects that are close, fast, or of an important type
+	priorities.updates.clear();
+	size_t count = visibleUpdates ? visibleUpdates->size() : snapshot.updates.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		VisibleUpdate visible = visibleUpdates ? (*visibleUpdates)[i] : VisibleUpdate{ (unsigned int)i, 0 };
+		const ObjectUpdate& update = snapshot.updates[visible.updateIndex];
+		if (!update.isAwake)
+		{
+			continue;
+		}
+
+		UpdatePriority& state = priorities.objects[update.id];
+		state.priority += getUpdatePriority(update, client.position);
+		state.seenSequence = snapshot.sequence;
+
+		// Skipped updates arent in the clients copy of the baseline, so they are sent in full, the same as objects that have just become visible
+		if (!baseline || !state.wasSent(baseline->sequence))
+		{
+			visible.visibleSequence = snapshot.sequence;
+		}
+		priorities.updates.push_back({ state.priority, update.id, visible, &state });
+	}
+
+	// Forget objects that have been asleep, out of range or destroyed for longer than a baseline is kept, since nothing about them is still useful
+	for (auto it = priorities.objects.begin(); it != priorities.objects.end();)
+	{
+		it = snapshot.sequence - it->second.seenSequence < sentSnapshotCount ? std::next(it) : priorities.objects.erase(it);
+	}
+
+	// Highest priority first, so the updates that dont fit in the budget are the least important. Ties go to the lowest ID
+	std::sort(priorities.updates.begin(), priorities.updates.end(), [](const PrioritisedUpdate& a, const PrioritisedUpdate& b)
+	{
+		return a.priority != b.priority ? a.priority > b.priority : a.id < b.id;
+	});
+	priorities.sendOrder.clear();
+	for (const PrioritisedUpdate& update : priorities.updates)
+	{
+		priorities.sendOrder.push_back(update.update);
+	}
+
+	size_t sentCount = sendSnapshotPackets(snapshot, true, baseline, &priorities.sendOrder, snapshotBudget, client.address);
+	for (size_t i = 0; i < sentCount; i++)
+	{
+		priorities.updates[i].state->priority = 0;
+		priorities.updates[i].state->markSent(snapshot.sequence);
+	}
+}
+
+float Server::getUpdatePriority(const ObjectUpdate& update, const raylib::Vector3& clientPosition) const
+{
+	auto type = typePriorities.find(update.typeID);
+	float priority = type != typePriorities.end() ? type->second : 1;
+
+	// Halves at priorityDistance from the client, and doubles at prioritySpeed
+	priority *= priorityDistance / (priorityDistance + Vector3Distance(update.position, clientPosition));
+	priority *= 1 + Vector3Length(update.velocity) / prioritySpeed;
+	return priority;
+}
+
+size_t Server::sendSnapshotPackets(const UpdateSnapshot& snapshot, bool isAwake, const SentSnapshot* baseline, const std::vector<VisibleUpdate>* visibleUpdates, int byteBudget, const RakNet::SystemAddress& address)
+{
+	// Only awake objects are part of the sequence, since they are what clients use as baselines
+	unsigned int sequence = isAwake ? snapshot.sequence : 0;
+	unsigned int baselineSequence = baseline ? baseline->sequence : 0;
+	PacketReliability reliability = isAwake ? UNRELIABLE : RELIABLE;
+	bool isBroadcast = address == RakNet::UNASSIGNED_SYSTEM_ADDRESS;
+	float maxBytes = peerInterface->GetMTUSize(RakNet::UNASSIGNED_SYSTEM_ADDRESS) * 0.95f;
+
+	// Every update shares the time stamp, which allows raknet to convert local times between systems
+	unsigned short packetIndex = 0;
+	auto writeHeader = [&](RakNet::BitStream& stream)
+	{
+		stream.Write((RakNet::MessageID)ID_TIMESTAMP);
+		stream.Write(snapshot.time);
+		stream.Write((RakNet::MessageID)ID_SERVER_SNAPSHOT);
+		stream.Write(sequence);
+		stream.Write(baselineSequence);
+		stream.Write(packetIndex);
+	};
+	// The header is the same size in every packet, so the budget can count it before a packet is started
+	RakNet::BitStream headerBits;
+	writeHeader(headerBits);
+
+	RakNet::BitStream bs;
+	RakNet::BitStream updateBits;
+	bool isEmpty = true;
+	size_t bytesSent = 0;
+	size_t writtenCount = 0;
+	size_t count = visibleUpdates ? visibleUpdates->size() : snapshot.updates.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = visibleUpdates ? (*visibleUpdates)[i].updateIndex : i;
+		const ObjectUpdate& update = snapshot.updates[index];
+		if (update.isAwake != isAwake)
+		{
+			continue;
+		}
+
+		// Each update is written on its own first, so its size is known before it is added to a packet.
+		// It is marked, so the client knows when it has read the last one
+		updateBits.Reset();
+		updateBits.Write(true);
+		updateBits.Write(update.id);
+
+		// Objects in the baseline are sent as differences from it, if the client could see them when it was sent.
+		// A bit says which, since the client keeps the states of objects that have gone out of range and come back
+		const QuantizedState* baselineState = nullptr;
+		unsigned int visibleSequence = visibleUpdates ? (*visibleUpdates)[i].visibleSequence : 0;
+		if (baseline && visibleSequence <= baseline->sequence)
+		{
+			auto found = std::lower_bound(baseline->states.begin(), baseline->states.end(), update.id, [](const std::pair<unsigned int, QuantizedState>& state, unsigned int id)
+			{
+				return state.first < id;
+			});
+			if (found != baseline->states.end() && found->first == update.id)
+			{
+				baselineState = &found->second;
+			}
+		}
+		updateBits.Write(baselineState != nullptr);
+		if (baselineState)
+		{
+			stateQuantizer.writeDelta(updateBits, snapshot.states[index], *baselineState);
+		}
+		else
+		{
+			stateQuantizer.write(updateBits, snapshot.states[index]);
+		}
+		updateBits.Write(update.isAwake);
+
+		// If the packet is almost full, send it and start a new one to prevent fragmenting. The last bit says if it is the last packet
+		if (!isEmpty && bs.GetNumberOfBytesUsed() > maxBytes)
+		{
+			bs.Write(false);
+			bs.Write(false);
+			peerInterface->Send(&bs, MEDIUM_PRIORITY, reliability, 1, address, isBroadcast);
+			bytesSent += bs.GetNumberOfBytesUsed();
+			bs.Reset();
+			packetIndex++;
+			isEmpty = true;
+		}
+
+		// Updates are in order of importance, so once one doesnt fit in the budget the rest can wait for a later snapshot.
+		// Counts the header of a new packet and the two bits that end it, so the packets sent never go over the budget
+		if (byteBudget >= 0)
+		{
+			size_t packetBits = (isEmpty ? headerBits.GetNumberOfBitsUsed() : bs.GetNumberOfBitsUsed()) + updateBits.GetNumberOfBitsUsed() + 2;
+			if (bytesSent + BITS_TO_BYTES(packetBits) > (size_t)byteBudget)
+			{
+				break;
+			}
+		}
+
+		if (isEmpty)
+		{
+			writeHeader(bs);
+			isEmpty = false;
+		}
+		bs.Write(&updateBits);
+		writtenCount++;
+	}
+
+	if (!isEmpty)
+	{
+		bs.Write(false);
+		bs.Write(true);
+		peerInterface->Send(&bs, MEDIUM_PRIORITY, reliability, 1, address, isBroadcast);
+	}
+	return writtenCount;
+}
+
+void Server::publishSnapshot(RakNet::Time timeStamp)
+{
+	// If the network thread hasnt taken the last snapshot yet, skip this one. Nothing is marked as sent, so sleeping objects try again next update
+	if (isSnapshotReady.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	collectUpdates(snapshots[writeSnapshot], timeStamp);
+
+	// Release, so the network thread sees the whole snapshot once it sees it is ready
+	readSnapshot = writeSnapshot;
+	writeSnapshot = 1 - writeSnapshot;
+	isSnapshotReady.store(true, std::memory_order_release);
+}
+
+void Server::networkLoop()
+{
+	// A packet that didnt fit in the queue, kept until there is room
+	RakNet::Packet* heldPacket = nullptr;
+	// Snapshots are sent using the job system. With its own queue, the simulation thread never runs the jobs this thread queues
+	jobSystem.registerThread();
+
+	while (isNetworkThreadRunning.load())
+	{
+		bool isIdle = true;
+
+		// Queue packets for the simulation thread. If the queue is full, wait for it to process some before receiving more
+		while (true)
+		{
+			if (!heldPacket)
+			{
+				heldPacket = peerInterface->Receive();
+			}
+			if (!heldPacket || !receivedPackets.push(heldPacket))
+			{
+				break;
+			}
+			heldPacket = nullptr;
+			isIdle = false;
+		}
+
+		// Take the published snapshot and send it. Clearing the flag first lets the simulation publish into the other snapshot while this one sends.
+		// It can only publish again once this snapshot has been sent and the next one taken, so it never writes over one being sent
+		if (isSnapshotReady.load(std::memory_order_acquire))
+		{
+			UpdateSnapshot& snapshot = snapshots[readSnapshot];
+			isSnapshotReady.store(false, std::memory_order_release);
+
+			sendSnapshot(snapshot);
+			isIdle = false;
+		}
+
+		if (isIdle)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	if (heldPacket)
+	{
+		peerInterface->DeallocatePacket(heldPacket);
+	}
+	jobSystem.unregisterThread();
 }
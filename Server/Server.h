@@ -3,10 +3,20 @@
 #include <RakPeerInterface.h>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <GetTime.h>
+#include <thread>
+#include <atomic>
 #include "../Shared/ClientObject.h"
 #include "../Shared/Sphere.h"
 #include "../Shared/OBB.h"
+#include "../Shared/Broadphase.h"
+#include "../Shared/ContactSolver.h"
+#include "../Shared/SpscQueue.h"
+#include "../Shared/StateQuantizer.h"
+#include "../Shared/InterestGrid.h"
+#include "TransformHistory.h"
+#include "TickGovernor.h"
 
 
 /// <summary>
@@ -15,7 +25,9 @@
 class Server
 {
 public:
-	Server(float timeStep = 0.01f);
+	/// <param name="timeStep">The fixed time step used for physics</param>
+	/// <param name="workerCount">The number of threads used to help with physics. If negative, one less than the number of hardware threads is used</param>
+	Server(float timeStep = 0.01f, int workerCount = -1);
 	virtual ~Server();
 
 
@@ -31,6 +43,36 @@ public:
 	void createObject(unsigned int typeID, const PhysicsState& state, const RakNet::Time& creationTime, RakNet::BitStream* customParamiters = nullptr);
 	// Destroy the object with the passed ID. Destruction will be syncronised across clients
 	void destroyObject(unsigned int objectID);
+
+	// Find the closest object hit by a ray. Returns true if something was hit
+	bool raycast(const RaycastQuery& ray, QueryHit& hitOut) const { return broadphase.raycast(ray, hitOut); }
+	// Find the closest object hit by each ray, using the job system. Rays that hit nothing have a null object
+	void raycastBatch(const std::vector<RaycastQuery>& rays, std::vector<QueryHit>& hitsOut) { broadphase.raycastBatch(rays, hitsOut, &jobSystem); }
+	// Find the first object hit by a shape moving along a ray. Returns true if something was hit
+	bool shapeCast(const Collider& shape, const raylib::Vector3& rotation, const RaycastQuery& path, QueryHit& hitOut) const { return broadphase.shapeCast(shape, rotation, path, hitOut); }
+	// Add every object overlapping a shape to objectsOut
+	void overlap(const Collider& shape, const raylib::Vector3& position, const raylib::Vector3& rotation, std::vector<StaticObject*>& objectsOut, unsigned int mask = 0xFFFFFFFF) const
+	{
+		broadphase.overlap(shape, position, rotation, objectsOut, mask);
+	}
+
+	/// <summary>
+	/// Move objects back to where they were at a time in the past, so hit tests match what a client saw when it acted.
+	/// Use the time stamp of the input, and do any queries while the returned scope exists. Objects return to the present when it is destroyed
+	/// </summary>
+	/// <param name="time">The time to rewind to. Limited to maxRewindTime before the last update</param>
+	TransformHistory::RewindScope rewind(RakNet::Time time, const std::vector<GameObject*>& objects);
+
+
+	/// <summary>
+	/// Receive packets and send object updates on a seperate thread, so the simulation doesnt wait on the network.
+	/// Call after peerInterface has started up. While running, do not call Receive on peerInterface, since systemUpdate will pass
+	/// every received packet to processSystemMessage and then processGameMessage
+	/// </summary>
+	void startNetworkThread();
+	// Stop the network thread, going back to receiving packets on the calling thread
+	void stopNetworkThread();
+	bool isNetworkThreaded() const { return networkThread.joinable(); }
 	
 protected:
 	// THESE FUNCTIONS ARE FOR THE USER TO USE WITHIN THE SERVER CLASS
@@ -39,6 +81,8 @@ protected:
 	void systemUpdate();
 	// Process packets that are used by the system
 	void processSystemMessage(const RakNet::Packet* packet);
+	// Called by systemUpdate for every packet received by the network thread, after processSystemMessage. Only used while the network thread is running
+	virtual void processGameMessage(const RakNet::Packet* packet) {}
 
 
 	/// <summary>
@@ -58,12 +102,16 @@ protected:
 
 
 	RakNet::Time getTime() const { return lastUpdateTime; }
+	// How many steps the last update ran, how overloaded the server is, and how far behind real time it has fallen
+	const TickGovernor& getTickGovernor() const { return tickGovernor; }
 
 private:
 	// THESE FUNCTIONS ARE ONLY USED INTERNALLY BY THE SYSTEM, AND ARE NOT FOR THE USER
 
 	// Check for collisions and resolve them
 	void collisionDetectionAndResolution();
+	// Move objects using continuous collision detection back to where they first touched something during the last physics step
+	void sweepFastObjects();
 
 	// Used to send data to a new client including client ID, static objects, game objects, and thier client object
 	void onClientConnect(const RakNet::SystemAddress& connectedAddress);
@@ -73,8 +121,127 @@ private:
 	// Process player input
 	void processInput(unsigned int clientID, RakNet::BitStream& bsIn, const RakNet::Time& timeStamp);
 
-	// Broadcast a message containing the game objects physics state. (Does not use serialize)
+	// The physics state of a game object at the end of an update, and if it is awake
+	struct ObjectUpdate
+	{
+		unsigned int id;
+		// Used to choose the quantization profile
+		int typeID;
+		raylib::Vector3 position;
+		Quat rotation;
+		raylib::Vector3 velocity;
+		raylib::Vector3 angularVelocity;
+		bool isAwake;
+	};
+	// A client to send a snapshot to, and the snapshot it last acknowledged, which updates are sent as differences from
+	struct SnapshotClient
+	{
+		unsigned int clientID;
+		RakNet::SystemAddress address;
+		unsigned int baselineSequence;
+		// Where the clients object was when the snapshot was collected. Used to prioritise nearby objects
+		raylib::Vector3 position = { 0, 0, 0 };
+	};
+	// An update a client can see, and the snapshot its object became visible to the client in. Updates can only be sent
+	// as differences from a baseline the object was visible in, since the client wasnt sent it before then
+	struct VisibleUpdate
+	{
+		unsigned int updateIndex;
+		unsigned int visibleSequence;
+	};
+	// The updates to send at the end of an update, and the time they are from
+	struct UpdateSnapshot
+	{
+		RakNet::Time time = 0;
+		// Counts up from 1 for every snapshot. 0 is used for updates that arent part of one
+		unsigned int sequence = 0;
+		std::vector<ObjectUpdate> updates;
+		std::vector<SnapshotClient> clients;
+		// The quantized state of each update, filled in when the snapshot is sent
+		std::vector<QuantizedState> states;
+		// Is each client only sent the updates it can see? If so, visibleUpdates has a list for each client, in the same order as clients
+		bool isFiltered = false;
+		std::vector<std::vector<VisibleUpdate>> visibleUpdates;
+	};
+	// The quantized states of awake objects sent in a snapshot, sorted by ID. Kept so they can be used as a baseline once acknowledged
+	struct SentSnapshot
+	{
+		unsigned int sequence = 0;
+		std::vector<std::pair<unsigned int, QuantizedState>> states;
+	};
+	// How long an awake object has waited to be sent to a client, and which of the last 64 snapshots it was sent to the client in
+	struct UpdatePriority
+	{
+		float priority = 0;
+		unsigned int seenSequence = 0;
+		unsigned int sentSequence = 0;
+		unsigned long long sentMask = 0;
+
+		bool wasSent(unsigned int sequence) const
+		{
+			unsigned int age = sentSequence - sequence;
+			return sentSequence != 0 && sequence <= sentSequence && age < 64 && ((sentMask >> age) & 1) != 0;
+		}
+		void markSent(unsigned int sequence)
+		{
+			unsigned int shift = sequence - sentSequence;
+			sentMask = sentSequence == 0 || shift >= 64 ? 1 : (sentMask << shift) | 1;
+			sentSequence = sequence;
+		}
+	};
+	// An update waiting to be sent to a client, with the priority it is sorted by
+	struct PrioritisedUpdate
+	{
+		float priority;
+		unsigned int id;
+		VisibleUpdate update;
+		UpdatePriority* state;
+	};
+	// The priority of every awake object a client can see, and space to sort them. Only used by the thread sending snapshots
+	struct ClientPriorities
+	{
+		std::unordered_map<unsigned int, UpdatePriority> objects;
+		std::vector<PrioritisedUpdate> updates;
+		std::vector<VisibleUpdate> sendOrder;
+	};
+
+	// Broadcast a message containing the game objects physics state, and if it is awake. (Does not use serialize)
 	void sendGameObjectUpdate(GameObject* object, RakNet::Time timeStamp);
+	void sendObjectUpdate(const ObjectUpdate& update, RakNet::Time timeStamp);
+	// Write an objects ID, physics state, and if it is awake, quantized with the profile for its type. Read by Client::applyServerUpdate
+	void writeObjectUpdate(RakNet::BitStream& bs, const ObjectUpdate& update) const;
+	// Fill a snapshot with the updates that need sending this update, marking sleeping objects that have sent their last one
+	void collectUpdates(UpdateSnapshot& snapshot, RakNet::Time timeStamp);
+	/// <summary>
+	/// Find the objects near each clients object. Objects that come into range are created on the client, and objects that go out of range are destroyed.
+	/// Fills visibleUpdates in the snapshot with the updates each client can see
+	/// </summary>
+	void updateInterest(UpdateSnapshot& snapshot);
+	// Tell clients to destroy an object. Only clients that can see it are told, if interest management is on
+	void sendDestroyObject(unsigned int objectID);
+	// Send every update in a snapshot. Sleeping objects are broadcast reliably in full, and awake objects are sent to each client
+	// as differences from the last snapshot it acknowledged
+	void sendSnapshot(UpdateSnapshot& snapshot);
+	/// <summary>
+	/// Send a client the awake updates it can see with the highest priority that fit in snapshotBudget. Every update gains priority,
+	/// and updates that are sent go back to nothing
+	/// </summary>
+	void sendPrioritisedUpdates(const UpdateSnapshot& snapshot, const SnapshotClient& client, const SentSnapshot* baseline, const std::vector<VisibleUpdate>* visibleUpdates, ClientPriorities& priorities);
+	/// <summary>
+	/// Send the updates for either awake or sleeping objects, packing as many as fit in the MTU into each packet
+	/// </summary>
+	/// <param name="baseline">Updates for objects in it are sent as differences from it. If null, every update is sent in full</param>
+	/// <param name="visibleUpdates">The updates the client can see, in the order to send them. If null, every update is sent</param>
+	/// <param name="byteBudget">Stop before the first update that would take the packets sent over this many bytes. Negative for no limit</param>
+	/// <param name="address">The client to send to. UNASSIGNED_SYSTEM_ADDRESS broadcasts to every client</param>
+	/// <returns>How many updates were written before running out of budget</returns>
+	size_t sendSnapshotPackets(const UpdateSnapshot& snapshot, bool isAwake, const SentSnapshot* baseline, const std::vector<VisibleUpdate>* visibleUpdates, int byteBudget, const RakNet::SystemAddress& address);
+	// How much an awake update gains in priority each snapshot it isnt sent to a client at a position
+	float getUpdatePriority(const ObjectUpdate& update, const raylib::Vector3& clientPosition) const;
+	// Copy the updates that need sending into the snapshot being written, and hand it to the network thread
+	void publishSnapshot(RakNet::Time timeStamp);
+	// Used by the network thread. Queues received packets, and sends snapshots as they are published
+	void networkLoop();
 
 
 
@@ -83,12 +250,11 @@ protected:
 	
 	// Objects used for static geometry. Need to be created on startup
 	std::vector<StaticObject*> staticObjects;
-	// All game objects that currently exist. Use createObject and destroyObject, do not insert or erase elements
-	// <object id, game object>
-	std::unordered_map<unsigned int, GameObject*> gameObjects;
-	// All client objects that currently exist. The system will create and delete them
-	// <client id, client object>
-	std::unordered_map<unsigned int, ClientObject*> clientObjects;
+	// All game objects that currently exist, with their physics state stored together. Objects can be found by ID with find.
+	// Use createObject and destroyObject, do not add or remove objects
+	BodyStorage gameObjects;
+	// All client objects that currently exist. The system will create and delete them. Every object in it is a ClientObject
+	BodyStorage clientObjects;
 
 	// Used to determine the client ID from a packets address
 	// <client address, client ID>
@@ -96,16 +262,98 @@ protected:
 
 	// The time used for physics steps
 	const float timeStep = 0.01f;
+	// Should pairs be checked for collisions on multiple threads? Contacts are sorted afterwards, so the result is the same either way
+	bool useParallelNarrowphase = true;
+	// How many times contacts are solved each physics step. More iterations let stacks of objects settle, but take longer
+	int solverIterations = 8;
+	// Game objects moving faster than this use continuous collision detection, even if they dont ask for it. Negative to disable
+	float ccdSpeedThreshold = -1;
+	// The furthest back in milliseconds that rewind can move objects. Stops clients with high latency from hitting objects long after they moved
+	RakNet::Time maxRewindTime = 500;
+	// Limits the physics steps run each update, and degrades the server when it cant keep up. Configure it with its setters
+	TickGovernor tickGovernor;
+	// Decides how precisely object updates are sent for each object type. Set up the same profiles as clients, before any connect
+	StateQuantizer stateQuantizer;
+	// Clients are only sent objects within this distance of their client object, ignoring height. Negative to send every object to every client.
+	// Set before any clients connect
+	float interestRadius = -1;
+	// Objects stay visible until they are this much further away than interestRadius, so objects near the edge arent created and destroyed over and over
+	float interestHysteresis = 10;
+	// The most bytes of awake object updates sent to each client in each snapshot. Objects that dont fit gain priority until they are sent,
+	// so the most important objects are sent most often. Negative for no limit. Set before any clients connect
+	int snapshotBudget = -1;
+	// How important each object type is. Types not in it have a priority of 1
+	// <type ID, priority>
+	std::unordered_map<int, float> typePriorities;
+	// The priority of an object halves at this distance from a clients object, and doubles at this speed
+	float priorityDistance = 32;
+	float prioritySpeed = 10;
 
 private:
 	// Object IDs to be destroied at the end of this update
 	std::vector<unsigned int> deadObjects;
+	// Object IDs of sleeping game objects that have sent their last update
+	std::unordered_set<unsigned int> sleepingObjects;
+
+	// Used to find pairs of objects that might be colliding
+	Broadphase broadphase;
+	// Pairs from the broadphase, and the contacts found from them this physics step
+	std::vector<CollisionPair> collisionPairs;
+	std::vector<Contact> contacts;
+	ContactSolver contactSolver;
+	// Where objects were over the last few updates, used for lag compensation
+	TransformHistory transformHistory;
+	// Objects using continuous collision detection this physics step, and where they started it
+	std::vector<std::pair<GameObject*, raylib::Vector3>> sweptObjects;
+	// Objects that might be in the way of the object being swept
+	std::vector<StaticObject*> sweepCandidates;
+	// Threads used to help with physics and sending updates
+	JobSystem jobSystem;
+
+	// Used to receive packets and send snapshots while the simulation runs
+	std::thread networkThread;
+	std::atomic<bool> isNetworkThreadRunning;
+	// Packets received by the network thread, waiting for systemUpdate to process them
+	SpscQueue<RakNet::Packet*> receivedPackets;
+	// The simulation writes one snapshot while the network thread sends the other. isSnapshotReady is set when a snapshot
+	// is published, and cleared when the network thread takes it to send
+	UpdateSnapshot snapshots[2];
+	int writeSnapshot = 0;
+	int readSnapshot = 1;
+	std::atomic<bool> isSnapshotReady;
+
+	// The sequence given to the next snapshot
+	unsigned int nextSnapshotSequence = 1;
+	// The latest snapshot each client has received all of, from the acknowledgements sent with their input
+	// <client ID, client address and snapshot sequence>
+	std::unordered_map<unsigned int, SnapshotClient> snapshotClients;
+	// The last few snapshots sent, indexed by sequence. Only used by the thread sending snapshots
+	static const unsigned int sentSnapshotCount = 64;
+	std::vector<SentSnapshot> sentSnapshots;
+
+	// A visible object, the snapshot it became visible in, and the last snapshot it was found in range
+	struct VisibleObject
+	{
+		unsigned int visibleSequence;
+		unsigned int seenSequence;
+	};
+	// The objects each client has been sent, when interest management is on. A clients own client object is never in it
+	// <client ID, <object ID, visible object>>
+	std::unordered_map<unsigned int, std::unordered_map<unsigned int, VisibleObject>> visibleObjects;
+	// Game and client objects by position, used to find the objects near each client
+	InterestGrid interestGrid;
+	// The index of each object in the snapshot being collected, and the ID and visible objects of each client in it. Kept to save allocating them each update
+	std::unordered_map<unsigned int, unsigned int> updateIndices;
+	std::vector<std::pair<unsigned int, std::unordered_map<unsigned int, VisibleObject>*>> interestClients;
+
+	// <client ID, priorities>
+	std::unordered_map<unsigned int, ClientPriorities> clientPriorities;
+	// The priorities of each client in the snapshot being sent, in the same order as its clients
+	std::vector<ClientPriorities*> priorityClients;
 
 	// Time in milliseconds. Multiply by 0.001 for seconds
 	RakNet::Time lastUpdateTime;
 
-	// Identifier for a client and the ClientObject they own. ALWAYS INCREMENT AFTER USE
-	unsigned int nextClientID = 1;
-	// Identifier for a GameObject. ALWAYS INCREMENT AFTER USE
-	unsigned int nextObjectID = 101;
+	// Gives out IDs for game objects, and for clients and the ClientObject they own. Freed IDs are reused with a new generation
+	SlotMap objectIDs;
 };
\ No newline at end of file
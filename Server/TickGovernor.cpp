@@ -0,0 +1,75 @@
+#include "TickGovernor.h"
+
+
+TickGovernor::TickGovernor(float timeStep) :
+	timeStep(timeStep)
+{}
+
+
+void TickGovernor::beginUpdate(float elapsedTime)
+{
+	updateStartTime = RakNet::GetTimeUS();
+	stepsThisUpdate = 0;
+	updateCount++;
+
+	// While dilating, only part of the real time is simulated and the rest is lost
+	float scale = level >= TimeDilation ? dilatedTimeScale : 1;
+	accumulatedTime += elapsedTime * scale;
+	timeBehind += elapsedTime * (1 - scale);
+}
+
+bool TickGovernor::shouldStep() const
+{
+	if (accumulatedTime < timeStep || stepsThisUpdate >= maxStepsPerUpdate)
+	{
+		return false;
+	}
+
+	// Always run one step, so the simulation keeps moving even if a single step is over budget
+	return stepsThisUpdate == 0 || (RakNet::GetTimeUS() - updateStartTime) * 0.000001f < updateBudget;
+}
+
+void TickGovernor::endStep()
+{
+	accumulatedTime -= timeStep;
+	stepsThisUpdate++;
+}
+
+void TickGovernor::endUpdate()
+{
+	lastUpdateDuration = (RakNet::GetTimeUS() - updateStartTime) * 0.000001f;
+
+	// Only keep as much backlog as the next update can catch up. Keeping more would make every update run the maximum steps
+	float maxBacklog = maxStepsPerUpdate * timeStep;
+	bool isBehind = accumulatedTime >= timeStep;
+	if (accumulatedTime > maxBacklog)
+	{
+		timeBehind += accumulatedTime - maxBacklog;
+		accumulatedTime = maxBacklog;
+	}
+
+	// Move up a level after a few overloaded updates in a row, and back down once updates are well under budget for a while
+	if (lastUpdateDuration > updateBudget || isBehind)
+	{
+		idleUpdates = 0;
+		if (++overloadedUpdates >= overloadedUpdatesToRaise && level < TimeDilation)
+		{
+			level = (OverloadLevel)(level + 1);
+			overloadedUpdates = 0;
+		}
+	}
+	else if (lastUpdateDuration < updateBudget * 0.5f)
+	{
+		overloadedUpdates = 0;
+		if (++idleUpdates >= idleUpdatesToLower && level > Normal)
+		{
+			level = (OverloadLevel)(level - 1);
+			idleUpdates = 0;
+		}
+	}
+	else
+	{
+		overloadedUpdates = 0;
+		idleUpdates = 0;
+	}
+}
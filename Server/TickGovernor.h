@@ -0,0 +1,91 @@
+#pragma once
+#include <GetTime.h>
+
+
+/// <summary>
+/// Decides how many fixed physics steps the server runs each update, so a slow update cant make the next one slower.
+/// Steps are capped per update and by a time budget, and any backlog bigger than the cap allows is dropped instead of caught up.
+/// While updates keep going over budget, the server degrades in stages until it keeps up again
+/// </summary>
+class TickGovernor
+{
+public:
+	// How much the server is cutting back. Each level includes the ones before it
+	enum OverloadLevel
+	{
+		// Running normally
+		Normal,
+		// Awake objects send updates less often
+		ReducedSendRate,
+		// Resting objects touching something fall asleep straight away, so they stop being checked for collisions
+		EarlySleep,
+		// Simulated time runs slower than real time
+		TimeDilation,
+	};
+
+
+	/// <param name="timeStep">The fixed time step used for physics</param>
+	TickGovernor(float timeStep);
+
+
+	// Start an update, adding the real time that has passed since the last one, in seconds
+	void beginUpdate(float elapsedTime);
+	// Should another physics step be run this update? At least one step is allowed whenever one is due
+	bool shouldStep() const;
+	// Call after each physics step
+	void endStep();
+	// Finish the update, dropping any backlog that cant be caught up and changing the overload level
+	void endUpdate();
+
+	// Should object updates be sent this update?
+	bool shouldSendUpdates() const { return level < ReducedSendRate || updateCount % reducedSendInterval == 0; }
+
+
+	// The most physics steps run in one update. Also limits how much backlog is kept
+	void setMaxStepsPerUpdate(int steps) { maxStepsPerUpdate = steps > 0 ? steps : 1; }
+	// The time, in seconds, an update can take before the server counts as overloaded
+	void setUpdateBudget(float seconds) { updateBudget = seconds; }
+	// How often awake objects send updates while the send rate is reduced. 2 is every second update
+	void setReducedSendInterval(int interval) { reducedSendInterval = interval > 0 ? interval : 1; }
+	// How fast simulated time runs compared to real time while dilating, between 0 and 1
+	void setDilatedTimeScale(float scale) { dilatedTimeScale = scale; }
+
+	OverloadLevel getOverloadLevel() const { return level; }
+	// The number of physics steps run in the last update
+	int getStepsLastUpdate() const { return stepsThisUpdate; }
+	// How long the last update took, in seconds
+	float getLastUpdateDuration() const { return lastUpdateDuration; }
+	/// <summary>
+	/// How far, in seconds, the simulation is behind real time. Includes time dropped when catching up was capped,
+	/// time lost to dilation, and the backlog still waiting to be stepped
+	/// </summary>
+	float getTimeBehind() const { return timeBehind + accumulatedTime; }
+
+
+private:
+	const float timeStep;
+
+	int maxStepsPerUpdate = 4;
+	float updateBudget = 0.008f;
+	int reducedSendInterval = 2;
+	float dilatedTimeScale = 0.5f;
+
+	// How many updates in a row need to be over budget before moving up a level, and under half the budget before moving down
+	const int overloadedUpdatesToRaise = 3;
+	const int idleUpdatesToLower = 60;
+
+	// Real time waiting to be simulated, in seconds
+	float accumulatedTime = 0;
+	// Time dropped or dilated away, in seconds
+	float timeBehind = 0;
+
+	OverloadLevel level = Normal;
+	int overloadedUpdates = 0;
+	int idleUpdates = 0;
+	unsigned int updateCount = 0;
+
+	// When the current update started, and how many steps it has run
+	RakNet::TimeUS updateStartTime = 0;
+	int stepsThisUpdate = 0;
+	float lastUpdateDuration = 0;
+};
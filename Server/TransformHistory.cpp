@@ -0,0 +1,217 @@
+#include "TransformHistory.h"
+#include <cstring>
+#include <algorithm>
+
+
+TransformHistory::RewindScope::RewindScope(RewindScope&& other) :
+	broadphase(other.broadphase), savedTransforms(std::move(other.savedTransforms))
+{
+	// The moved from scope no longer owns anything to restore
+	other.savedTransforms.clear();
+}
+
+TransformHistory::RewindScope::~RewindScope()
+{
+	for (unsigned int i = 0; i < savedTransforms.size(); i++)
+	{
+		const SavedTransform& saved = savedTransforms[i];
+		setTransform(saved.object, saved.position, saved.rotation);
+		broadphase->updateObject(saved.object);
+	}
+}
+
+
+TransformHistory::TransformHistory(size_t frameCount) :
+	frameCount(frameCount > 0 ? frameCount : 1), frameTimes(this->frameCount, 0)
+{}
+
+
+void TransformHistory::record(RakNet::Time time, const BodyStorage& gameObjects, const BodyStorage& clientObjects)
+{
+	beginFrame(time);
+
+	for (GameObject* object : gameObjects)
+	{
+		recordObject(object);
+	}
+	for (GameObject* object : clientObjects)
+	{
+		recordObject(object);
+	}
+}
+
+void TransformHistory::forget(GameObject* object)
+{
+	int slot = object->historySlot;
+	if (slot == -1)
+	{
+		return;
+	}
+
+	// Old frames should not move the next object to use this slot
+	for (size_t frame = 0; frame < frameCount; frame++)
+	{
+		isRecorded[frame * capacity + slot] = 0;
+	}
+
+	freeSlots.push_back(slot);
+	object->historySlot = -1;
+}
+
+void TransformHistory::clear()
+{
+	// Slots are kept, since objects still hold theirs and will record into them next frame
+	recordedFrames = 0;
+	newestFrame = 0;
+	std::fill(isRecorded.begin(), isRecorded.end(), 0);
+}
+
+
+TransformHistory::RewindScope TransformHistory::rewind(RakNet::Time time, const std::vector<GameObject*>& objects, Broadphase& broadphase) const
+{
+	RewindScope scope(&broadphase);
+	if (recordedFrames == 0 || time >= frameTimes[newestFrame])
+	{
+		return scope;
+	}
+
+	// Walk back from the newest frame to find the two frames the time is between
+	size_t after = newestFrame;
+	size_t before = newestFrame;
+	for (size_t i = 1; i < recordedFrames; i++)
+	{
+		before = (newestFrame + frameCount - i) % frameCount;
+		if (frameTimes[before] <= time)
+		{
+			break;
+		}
+		after = before;
+	}
+
+	// If the time is older than every frame, use the oldest one
+	float fraction = 0;
+	if (before != after && frameTimes[after] > frameTimes[before] && time > frameTimes[before])
+	{
+		fraction = (float)(time - frameTimes[before]) / (frameTimes[after] - frameTimes[before]);
+	}
+
+	size_t beforeOffset = before * capacity;
+	size_t afterOffset = after * capacity;
+	scope.savedTransforms.reserve(objects.size());
+	for (GameObject* object : objects)
+	{
+		int slot = object->historySlot;
+		if (slot == -1 || !isRecorded[beforeOffset + slot])
+		{
+			continue;
+		}
+
+		scope.savedTransforms.push_back({ object, object->getPosition(), object->getOrientation() });
+
+		raylib::Vector3 position(positionX[beforeOffset + slot], positionY[beforeOffset + slot], positionZ[beforeOffset + slot]);
+		Quat rotation(rotationX[beforeOffset + slot], rotationY[beforeOffset + slot], rotationZ[beforeOffset + slot], rotationW[beforeOffset + slot]);
+		if (fraction > 0 && isRecorded[afterOffset + slot])
+		{
+			raylib::Vector3 afterPosition(positionX[afterOffset + slot], positionY[afterOffset + slot], positionZ[afterOffset + slot]);
+			position = Vector3Lerp(position, afterPosition, fraction);
+
+			Quat afterRotation(rotationX[afterOffset + slot], rotationY[afterOffset + slot], rotationZ[afterOffset + slot], rotationW[afterOffset + slot]);
+			rotation = Quat::nlerp(rotation, afterRotation, fraction);
+		}
+
+		setTransform(object, position, rotation);
+		broadphase.updateObject(object);
+	}
+
+	return scope;
+}
+
+RakNet::Time TransformHistory::getOldestTime() const
+{
+	if (recordedFrames == 0)
+	{
+		return 0;
+	}
+	return frameTimes[(newestFrame + frameCount - (recordedFrames - 1)) % frameCount];
+}
+
+
+void TransformHistory::beginFrame(RakNet::Time time)
+{
+	newestFrame = recordedFrames == 0 ? 0 : (newestFrame + 1) % frameCount;
+	recordedFrames = recordedFrames < frameCount ? recordedFrames + 1 : frameCount;
+	frameTimes[newestFrame] = time;
+
+	// Clear the frame being overwritten, so objects destroyed since are not found in it
+	if (capacity > 0)
+	{
+		memset(&isRecorded[newestFrame * capacity], 0, capacity);
+	}
+}
+
+void TransformHistory::recordObject(GameObject* object)
+{
+	if (!object->getCollider())
+	{
+		return;
+	}
+
+	// Give the object a slot the first time it is recorded
+	if (object->historySlot == -1)
+	{
+		if (!freeSlots.empty())
+		{
+			object->historySlot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			if ((size_t)slotCount == capacity)
+			{
+				grow(capacity > 0 ? capacity * 2 : 256);
+			}
+			object->historySlot = slotCount++;
+		}
+	}
+
+	size_t index = newestFrame * capacity + object->historySlot;
+	positionX[index] = object->position().x;
+	positionY[index] = object->position().y;
+	positionZ[index] = object->position().z;
+	rotationX[index] = object->rotation().x;
+	rotationY[index] = object->rotation().y;
+	rotationZ[index] = object->rotation().z;
+	rotationW[index] = object->rotation().w;
+	isRecorded[index] = 1;
+}
+
+void TransformHistory::grow(size_t newCapacity)
+{
+	// Copy each frame into its place in the larger arrays
+	auto growArray = [&](auto& values)
+	{
+		typename std::remove_reference<decltype(values)>::type newValues(frameCount * newCapacity, 0);
+		for (size_t frame = 0; frame < frameCount && capacity > 0; frame++)
+		{
+			std::copy(values.begin() + frame * capacity, values.begin() + (frame + 1) * capacity, newValues.begin() + frame * newCapacity);
+		}
+		values.swap(newValues);
+	};
+
+	growArray(positionX);
+	growArray(positionY);
+	growArray(positionZ);
+	growArray(rotationX);
+	growArray(rotationY);
+	growArray(rotationZ);
+	growArray(rotationW);
+	growArray(isRecorded);
+	capacity = newCapacity;
+}
+
+
+void TransformHistory::setTransform(GameObject* object, const raylib::Vector3& position, const Quat& rotation)
+{
+	object->position() = position;
+	object->rotation() = rotation;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "../Shared/GameObject.h"
+#include "../Shared/Broadphase.h"
+#include <GetTime.h>
+#include <vector>
+
+
+/// <summary>
+/// Records where game objects were over the last few updates, so they can be moved back to where a client saw them when
+/// checking if its shots hit. Each frame stores positions and rotations in seperate arrays, indexed by a slot each object 
+/// keeps, so recording is a single pass with no lookups. Memory is only allocated when more objects exist than ever before
+/// </summary>
+class TransformHistory
+{
+public:
+	/// <summary>
+	/// Moves objects back to where they were in the past, and returns them to where they are now when destroyed.
+	/// Objects must not be moved or destroyed while it exists
+	/// </summary>
+	class RewindScope
+	{
+	public:
+		RewindScope(RewindScope&& other);
+		~RewindScope();
+
+		RewindScope(const RewindScope&) = delete;
+		RewindScope& operator=(const RewindScope&) = delete;
+
+	private:
+		friend TransformHistory;
+		RewindScope(Broadphase* broadphase) : broadphase(broadphase) {}
+
+		struct SavedTransform
+		{
+			GameObject* object;
+			raylib::Vector3 position;
+			Quat rotation;
+		};
+
+		// Used to update the proxies of moved objects, so queries find them where they were
+		Broadphase* broadphase;
+		// Where each rewound object is in the present
+		std::vector<SavedTransform> savedTransforms;
+	};
+
+
+	/// <param name="frameCount">How many updates are kept. Older updates are overwritten</param>
+	TransformHistory(size_t frameCount = 64);
+
+
+	/// <summary>
+	/// Record where every game and client object with a collider is. Should be called once per update, after physics
+	/// </summary>
+	/// <param name="time">The time the objects are at, matching the time stamp sent to clients with their state</param>
+	void record(RakNet::Time time, const BodyStorage& gameObjects, const BodyStorage& clientObjects);
+	// Remove an object from the history. Needs to be called before the object is deleted, so its slot can be reused
+	void forget(GameObject* object);
+	// Remove every frame. Objects keep their slots, so they must still be forgotten before they are deleted
+	void clear();
+
+	/// <summary>
+	/// Move objects to where they were at a time in the past, interpolating between recorded frames. Times older than the 
+	/// oldest frame use the oldest frame, and objects that were not recorded at that time are not moved
+	/// </summary>
+	/// <param name="broadphase">The broadphase the objects are in, so spatial queries see them where they were</param>
+	/// <returns>A scope that moves the objects back to the present when destroyed</returns>
+	RewindScope rewind(RakNet::Time time, const std::vector<GameObject*>& objects, Broadphase& broadphase) const;
+
+	// The time of the oldest frame kept, or 0 if nothing has been recorded
+	RakNet::Time getOldestTime() const;
+
+private:
+	// Start a new frame, overwriting the oldest one if the history is full
+	void beginFrame(RakNet::Time time);
+	// Store an objects transform in the newest frame, giving it a slot if it doesnt have one
+	void recordObject(GameObject* object);
+	// Make room for more slots, keeping the recorded frames
+	void grow(size_t newCapacity);
+
+	// Set an objects transform directly
+	static void setTransform(GameObject* object, const raylib::Vector3& position, const Quat& rotation);
+
+
+private:
+	const size_t frameCount;
+	// The number of frames recorded, up to frameCount, and the index of the newest one
+	size_t recordedFrames = 0;
+	size_t newestFrame = 0;
+	std::vector<RakNet::Time> frameTimes;
+
+	// Values for slot s in frame f are stored at f * capacity + s
+	size_t capacity = 0;
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	// Was the slot recorded in the frame? Slots are reused, so this is cleared when an object is forgotten
+	std::vector<unsigned char> isRecorded;
+
+	// Slots that are no longer used, and the number of slots ever given out
+	std::vector<int> freeSlots;
+	int slotCount = 0;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include "raylib-cpp.hpp"
+
+
+/// <summary>
+/// An axis aligned bounding box. Used by the broadphase to quickly find objects that might be colliding
+/// </summary>
+struct AABB
+{
+	AABB() :
+		lower(0, 0, 0), upper(0, 0, 0)
+	{}
+	AABB(raylib::Vector3 lower, raylib::Vector3 upper) :
+		lower(lower), upper(upper)
+	{}
+
+
+	// Do the two boxes overlap?
+	bool overlaps(const AABB& other) const
+	{
+		return lower.x <= other.upper.x && upper.x >= other.lower.x &&
+			   lower.y <= other.upper.y && upper.y >= other.lower.y &&
+			   lower.z <= other.upper.z && upper.z >= other.lower.z;
+	}
+
+	// Is the other box entirely inside this one?
+	bool contains(const AABB& other) const
+	{
+		return lower.x <= other.lower.x && upper.x >= other.upper.x &&
+			   lower.y <= other.lower.y && upper.y >= other.upper.y &&
+			   lower.z <= other.lower.z && upper.z >= other.upper.z;
+	}
+
+	/// <summary>
+	/// Does a ray hit this box before maxDistance? Takes the inverse of the ray's direction, so it can be reused for every box
+	/// </summary>
+	bool intersectsRay(const raylib::Vector3& origin, const raylib::Vector3& inverseDirection, float maxDistance) const
+	{
+		// Slab test. fminf and fmaxf ignore the NaNs made by rays parallel to a slab and starting on its edge
+		float t1 = (lower.x - origin.x) * inverseDirection.x;
+		float t2 = (upper.x - origin.x) * inverseDirection.x;
+		float tMin = fminf(t1, t2);
+		float tMax = fmaxf(t1, t2);
+
+		t1 = (lower.y - origin.y) * inverseDirection.y;
+		t2 = (upper.y - origin.y) * inverseDirection.y;
+		tMin = fmaxf(tMin, fminf(t1, t2));
+		tMax = fminf(tMax, fmaxf(t1, t2));
+
+		t1 = (lower.z - origin.z) * inverseDirection.z;
+		t2 = (upper.z - origin.z) * inverseDirection.z;
+		tMin = fmaxf(tMin, fminf(t1, t2));
+		tMax = fminf(tMax, fmaxf(t1, t2));
+
+		return tMax >= fmaxf(tMin, 0) && tMin <= maxDistance;
+	}
+
+	// Used as the cost of a box when building trees. Half the surface area is enough for comparisons
+	float getSurfaceArea() const
+	{
+		float x = upper.x - lower.x;
+		float y = upper.y - lower.y;
+		float z = upper.z - lower.z;
+		return x * y + y * z + z * x;
+	}
+
+	// Returns a box grown by amount in every direction
+	AABB expanded(float amount) const
+	{
+		return AABB(Vector3SubtractValue(lower, amount), Vector3AddValue(upper, amount));
+	}
+
+	// Returns the smallest box containing both boxes
+	static AABB combine(const AABB& a, const AABB& b)
+	{
+		return AABB(Vector3Min(a.lower, b.lower), Vector3Max(a.upper, b.upper));
+	}
+
+
+	raylib::Vector3 lower;
+	raylib::Vector3 upper;
+};
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include "AABBTree.h"
+
+
+AABBTree::AABBTree(float margin) :
+	root(nullNode), freeList(nullNode), margin(margin)
+{}
+
+
+int AABBTree::createProxy(const AABB& aabb, StaticObject* object)
+{
+	int proxyID = allocateNode();
+
+	// Fatten the box so the proxy does not need to be moved every time the object does
+	nodes[proxyID].aabb = aabb.expanded(margin);
+	nodes[proxyID].object = object;
+	nodes[proxyID].height = 0;
+
+	insertLeaf(proxyID);
+	return proxyID;
+}
+
+void AABBTree::destroyProxy(int proxyID)
+{
+	removeLeaf(proxyID);
+	freeNode(proxyID);
+}
+
+bool AABBTree::moveProxy(int proxyID, const AABB& aabb, const raylib::Vector3& displacement)
+{
+	// If the object is still inside its fattened box, nothing needs to change
+	if (nodes[proxyID].aabb.contains(aabb))
+	{
+		return false;
+	}
+
+	removeLeaf(proxyID);
+
+	// Fatten the box, and extend it in the direction of motion to predict where the object will be
+	AABB fatAABB = aabb.expanded(margin);
+	if (displacement.x < 0) fatAABB.lower.x += displacement.x; else fatAABB.upper.x += displacement.x;
+	if (displacement.y < 0) fatAABB.lower.y += displacement.y; else fatAABB.upper.y += displacement.y;
+	if (displacement.z < 0) fatAABB.lower.z += displacement.z; else fatAABB.upper.z += displacement.z;
+	nodes[proxyID].aabb = fatAABB;
+
+	insertLeaf(proxyID);
+	return true;
+}
+
+void AABBTree::clear()
+{
+	nodes.clear();
+	root = nullNode;
+	freeList = nullNode;
+}
+
+
+int AABBTree::allocateNode()
+{
+	// If there are no free nodes, add a new one
+	if (freeList == nullNode)
+	{
+		nodes.emplace_back();
+		return (int)nodes.size() - 1;
+	}
+
+	// Take a node from the free list
+	int nodeID = freeList;
+	freeList = nodes[nodeID].parent;
+	nodes[nodeID] = Node();
+	return nodeID;
+}
+
+void AABBTree::freeNode(int nodeID)
+{
+	nodes[nodeID].parent = freeList;
+	nodes[nodeID].object = nullptr;
+	nodes[nodeID].height = -1;
+	freeList = nodeID;
+}
+
+
+void AABBTree::insertLeaf(int leaf)
+{
+	if (root == nullNode)
+	{
+		root = leaf;
+		nodes[root].parent = nullNode;
+		return;
+	}
+
+	// Find the best sibling for the new leaf, using the surface area heuristic
+	AABB leafAABB = nodes[leaf].aabb;
+	int index = root;
+	while (!nodes[index].isLeaf())
+	{
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+
+		float area = nodes[index].aabb.getSurfaceArea();
+		float combinedArea = AABB::combine(nodes[index].aabb, leafAABB).getSurfaceArea();
+
+		// Cost of creating a new parent for this node and the new leaf
+		float cost = 2.0f * combinedArea;
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		// Cost of descending into each child
+		float cost1 = AABB::combine(leafAABB, nodes[child1].aabb).getSurfaceArea() + inheritanceCost;
+		if (!nodes[child1].isLeaf())
+		{
+			cost1 -= nodes[child1].aabb.getSurfaceArea();
+		}
+		float cost2 = AABB::combine(leafAABB, nodes[child2].aabb).getSurfaceArea() + inheritanceCost;
+		if (!nodes[child2].isLeaf())
+		{
+			cost2 -= nodes[child2].aabb.getSurfaceArea();
+		}
+
+		// Stop descending if it is cheapest to pair with this node
+		if (cost < cost1 && cost < cost2)
+		{
+			break;
+		}
+
+		index = (cost1 < cost2) ? child1 : child2;
+	}
+	int sibling = index;
+
+
+	// Create a new parent for the sibling and the leaf
+	int oldParent = nodes[sibling].parent;
+	int newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].aabb = AABB::combine(leafAABB, nodes[sibling].aabb);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != nullNode)
+	{
+		// The sibling was not the root
+		if (nodes[oldParent].child1 == sibling)
+		{
+			nodes[oldParent].child1 = newParent;
+		}
+		else
+		{
+			nodes[oldParent].child2 = newParent;
+		}
+	}
+	else
+	{
+		// The sibling was the root
+		root = newParent;
+	}
+
+
+	// Walk back up the tree fixing heights and boxes
+	index = nodes[leaf].parent;
+	while (index != nullNode)
+	{
+		index = balance(index);
+
+		int child1 = nodes[index].child1;
+		int child2 = nodes[index].child2;
+		nodes[index].height = 1 + (nodes[child1].height > nodes[child2].height ? nodes[child1].height : nodes[child2].height);
+		nodes[index].aabb = AABB::combine(nodes[child1].aabb, nodes[child2].aabb);
+
+		index = nodes[index].parent;
+	}
+}
+
+void AABBTree::removeLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = nullNode;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent != nullNode)
+	{
+		// Destroy the parent and connect the sibling to the grand parent
+		if (nodes[grandParent].child1 == parent)
+		{
+			nodes[grandParent].child1 = sibling;
+		}
+		else
+		{
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		// Adjust ancestor bounds
+		int index = grandParent;
+		while (index != nullNode)
+		{
+			index = balance(index);
+
+			int child1 = nodes[index].child1;
+			int child2 = nodes[index].child2;
+			nodes[index].aabb = AABB::combine(nodes[child1].aabb, nodes[child2].aabb);
+			nodes[index].height = 1 + (nodes[child1].height > nodes[child2].height ? nodes[child1].height : nodes[child2].height);
+
+			index = nodes[index].parent;
+		}
+	}
+	else
+	{
+		// The parent was the root, so the sibling becomes the root
+		root = sibling;
+		nodes[sibling].parent = nullNode;
+		freeNode(parent);
+	}
+}
+
+int AABBTree::balance(int iA)
+{
+	Node* A = &nodes[iA];
+	if (A->isLeaf() || A->height < 2)
+	{
+		return iA;
+	}
+
+	int iB = A->child1;
+	int iC = A->child2;
+	Node* B = &nodes[iB];
+	Node* C = &nodes[iC];
+
+	int balanceFactor = C->height - B->height;
+
+	// Rotate C up
+	if (balanceFactor > 1)
+	{
+		int iF = C->child1;
+		int iG = C->child2;
+		Node* F = &nodes[iF];
+		Node* G = &nodes[iG];
+
+		// Swap A and C
+		C->child1 = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		// A's old parent should point to C
+		if (C->parent != nullNode)
+		{
+			if (nodes[C->parent].child1 == iA)
+			{
+				nodes[C->parent].child1 = iC;
+			}
+			else
+			{
+				nodes[C->parent].child2 = iC;
+			}
+		}
+		else
+		{
+			root = iC;
+		}
+
+		// Keep the taller of F and G under C
+		if (F->height > G->height)
+		{
+			C->child2 = iF;
+			A->child2 = iG;
+			G->parent = iA;
+			A->aabb = AABB::combine(B->aabb, G->aabb);
+			C->aabb = AABB::combine(A->aabb, F->aabb);
+
+			A->height = 1 + (B->height > G->height ? B->height : G->height);
+			C->height = 1 + (A->height > F->height ? A->height : F->height);
+		}
+		else
+		{
+			C->child2 = iG;
+			A->child2 = iF;
+			F->parent = iA;
+			A->aabb = AABB::combine(B->aabb, F->aabb);
+			C->aabb = AABB::combine(A->aabb, G->aabb);
+
+			A->height = 1 + (B->height > F->height ? B->height : F->height);
+			C->height = 1 + (A->height > G->height ? A->height : G->height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (balanceFactor < -1)
+	{
+		int iD = B->child1;
+		int iE = B->child2;
+		Node* D = &nodes[iD];
+		Node* E = &nodes[iE];
+
+		// Swap A and B
+		B->child1 = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		// A's old parent should point to B
+		if (B->parent != nullNode)
+		{
+			if (nodes[B->parent].child1 == iA)
+			{
+				nodes[B->parent].child1 = iB;
+			}
+			else
+			{
+				nodes[B->parent].child2 = iB;
+			}
+		}
+		else
+		{
+			root = iB;
+		}
+
+		// Keep the taller of D and E under B
+		if (D->height > E->height)
+		{
+			B->child2 = iD;
+			A->child1 = iE;
+			E->parent = iA;
+			A->aabb = AABB::combine(C->aabb, E->aabb);
+			B->aabb = AABB::combine(A->aabb, D->aabb);
+
+			A->height = 1 + (C->height > E->height ? C->height : E->height);
+			B->height = 1 + (A->height > D->height ? A->height : D->height);
+		}
+		else
+		{
+			B->child2 = iE;
+			A->child1 = iD;
+			D->parent = iA;
+			A->aabb = AABB::combine(C->aabb, D->aabb);
+			B->aabb = AABB::combine(A->aabb, E->aabb);
+
+			A->height = 1 + (C->height > D->height ? C->height : D->height);
+			B->height = 1 + (A->height > E->height ? A->height : E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
\ No newline at end of file
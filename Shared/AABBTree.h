@@ -0,0 +1,156 @@
+#pragma once
+#include "AABB.h"
+#include <vector>
+
+// Forward declaration
+class StaticObject;
+
+
+/// <summary>
+/// A dynamic bounding volume tree. Each object is stored as a leaf with a fattened box, so small movements
+/// do not require the tree to be changed. Insertion uses the surface area heuristic, and the tree is kept balanced with rotations
+/// </summary>
+class AABBTree
+{
+public:
+	AABBTree(float margin = 0.1f);
+
+
+	/// <summary>
+	/// Add a proxy to the tree. The box will be fattened by the margin
+	/// </summary>
+	/// <returns>The ID of the new proxy, used to move and destroy it</returns>
+	int createProxy(const AABB& aabb, StaticObject* object);
+	// Remove a proxy from the tree
+	void destroyProxy(int proxyID);
+	/// <summary>
+	/// Move a proxy to a new box. Nothing will change if the box is still inside the proxies fattened box
+	/// </summary>
+	/// <param name="displacement">How far the object is expected to move. Used to extend the fattened box in the direction of motion</param>
+	/// <returns>True if the proxy was reinserted</returns>
+	bool moveProxy(int proxyID, const AABB& aabb, const raylib::Vector3& displacement);
+	// Remove all proxies
+	void clear();
+
+	/// <summary>
+	/// Call callback with the ID of every proxy overlapping the box. If the callback returns false, the query will stop
+	/// </summary>
+	template<class Callback>
+	void query(const AABB& aabb, Callback callback) const
+	{
+		if (root == nullNode)
+		{
+			return;
+		}
+
+		// Depth first search using a fixed stack. A balanced tree will never come close to filling it
+		int stack[256];
+		int count = 0;
+		stack[count++] = root;
+
+		while (count > 0)
+		{
+			int nodeID = stack[--count];
+			const Node& node = nodes[nodeID];
+			if (!node.aabb.overlaps(aabb))
+			{
+				continue;
+			}
+
+			if (node.isLeaf())
+			{
+				if (!callback(nodeID))
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack[count++] = node.child1;
+				stack[count++] = node.child2;
+			}
+		}
+	}
+
+
+	/// <summary>
+	/// Call callback with the ID of every proxy whose box is hit by the ray. The callback returns how far along the ray to keep searching,
+	/// so returning the distance of a hit skips anything further away
+	/// </summary>
+	template<class Callback>
+	void raycast(const raylib::Vector3& origin, const raylib::Vector3& direction, float maxDistance, Callback callback) const
+	{
+		if (root == nullNode)
+		{
+			return;
+		}
+
+		raylib::Vector3 inverseDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+		int stack[256];
+		int count = 0;
+		stack[count++] = root;
+
+		while (count > 0)
+		{
+			int nodeID = stack[--count];
+			const Node& node = nodes[nodeID];
+			if (!node.aabb.intersectsRay(origin, inverseDirection, maxDistance))
+			{
+				continue;
+			}
+
+			if (node.isLeaf())
+			{
+				maxDistance = callback(nodeID);
+			}
+			else
+			{
+				stack[count++] = node.child1;
+				stack[count++] = node.child2;
+			}
+		}
+	}
+
+
+	StaticObject* getObject(int proxyID) const { return nodes[proxyID].object; }
+	const AABB& getFatAABB(int proxyID) const { return nodes[proxyID].aabb; }
+	int getHeight() const { return root == nullNode ? 0 : nodes[root].height; }
+
+	// Used to represent a node that does not exist
+	static const int nullNode = -1;
+
+private:
+	struct Node
+	{
+		AABB aabb;
+		// The object this proxy belongs to. Only used by leaves
+		StaticObject* object = nullptr;
+
+		// Free nodes use parent to point to the next free node
+		int parent = nullNode;
+		int child1 = nullNode;
+		int child2 = nullNode;
+		// Leaves have a height of 0, free nodes -1
+		int height = -1;
+
+		bool isLeaf() const { return child1 == nullNode; }
+	};
+
+	int allocateNode();
+	void freeNode(int nodeID);
+
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	// Perform a rotation at nodeID if it is unbalanced. Returns the node that is now in its place
+	int balance(int nodeID);
+
+
+private:
+	std::vector<Node> nodes;
+	int root;
+	// Head of the linked list of free nodes
+	int freeList;
+
+	// How much to fatten boxes by on each side
+	const float margin;
+};
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "BodyStorage.h"
+#include "GameObject.h"
+#include "IntegrationKernels.h"
+#include "JobSystem.h"
+
+// The kernels treat vectors as 3 floats in a row
+static_assert(sizeof(raylib::Vector3) == 3 * sizeof(float), "Vector3 needs to be tightly packed");
+
+
+BodyStorage::~BodyStorage()
+{
+	// Objects may still exist, so make sure they dont use the arrays
+	clear();
+}
+
+
+bool BodyStorage::add(GameObject* object)
+{
+	if (object->bodies || !ids.insert(object->getID()))
+	{
+		return false;
+	}
+
+	// The slot map put the ID at the end, so the state goes there too
+	object->bodies = this;
+	object->bodyIndex = (unsigned int)objects.size();
+	objects.push_back(object);
+
+	positions.push_back(object->detachedPosition);
+	rotations.push_back(object->detachedRotation);
+	velocities.push_back(object->detachedVelocity);
+	angularVelocities.push_back(object->detachedAngularVelocity);
+	inverseMasses.push_back(object->detachedInverseMass);
+	flags.push_back(object->detachedFlags);
+	return true;
+}
+
+void BodyStorage::remove(GameObject* object)
+{
+	if (object->bodies != this)
+	{
+		return;
+	}
+
+	// Move the state back into the object, so it can still be used
+	unsigned int index = object->bodyIndex;
+	object->detachedPosition = positions[index];
+	object->detachedRotation = rotations[index];
+	object->detachedVelocity = velocities[index];
+	object->detachedAngularVelocity = angularVelocities[index];
+	object->detachedInverseMass = inverseMasses[index];
+	object->detachedFlags = flags[index];
+	object->bodies = nullptr;
+
+	// The slot map moves the last ID into the gap, so do the same with the state
+	ids.remove(object->getID());
+	unsigned int last = (unsigned int)objects.size() - 1;
+	if (index != last)
+	{
+		objects[index] = objects[last];
+		positions[index] = positions[last];
+		rotations[index] = rotations[last];
+		velocities[index] = velocities[last];
+		angularVelocities[index] = angularVelocities[last];
+		inverseMasses[index] = inverseMasses[last];
+		flags[index] = flags[last];
+		objects[index]->bodyIndex = index;
+	}
+
+	objects.pop_back();
+	positions.pop_back();
+	rotations.pop_back();
+	velocities.pop_back();
+	angularVelocities.pop_back();
+	inverseMasses.pop_back();
+	flags.pop_back();
+}
+
+void BodyStorage::clear()
+{
+	// Removing the last object doesnt move anything
+	while (!objects.empty())
+	{
+		remove(objects.back());
+	}
+}
+
+
+void BodyStorage::integrate(float timeStep, JobSystem* jobSystem)
+{
+	size_t count = objects.size();
+	if (count == 0)
+	{
+		return;
+	}
+
+	stepTimes.resize(count);
+	linearDrags.resize(count);
+	angularDrags.resize(count);
+
+	// Sleeping and fixedUpdate can change anything, so are done one object at a time. Objects that shouldnt move get a step time of 0
+	for (size_t i = 0; i < count; i++)
+	{
+		GameObject* object = objects[i];
+		stepTimes[i] = object->prepareStep(timeStep) ? timeStep : 0;
+		linearDrags[i] = object->linearDrag;
+		angularDrags[i] = object->angularDrag;
+	}
+
+	// Each object only reads and writes its own row, so ranges of objects can be moved on different threads
+	auto integrateRange = [this](size_t begin, size_t end)
+	{
+		// Rotation uses the angular velocity from before drag, so needs to be done first
+		for (size_t i = begin; i < end; i++)
+		{
+			if (stepTimes[i] != 0 && (flags[i] & LockRotation) == 0)
+			{
+				rotations[i] = rotations[i].integrated(angularVelocities[i], stepTimes[i]);
+			}
+		}
+
+		IntegrationKernels::integrate(&positions[begin].x, &velocities[begin].x, &angularVelocities[begin].x,
+			&stepTimes[begin], &linearDrags[begin], &angularDrags[begin], end - begin);
+	};
+
+	if (jobSystem)
+	{
+		jobSystem->parallelForRange(count, integrateRange, 256);
+	}
+	else
+	{
+		integrateRange(0, count);
+	}
+}
+
+
+GameObject* BodyStorage::find(unsigned int id) const
+{
+	int index = ids.find(id);
+	return index == -1 ? nullptr : objects[index];
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "raylib-cpp.hpp"
+#include "SlotMap.h"
+#include "PhysicsMath.h"
+#include <vector>
+
+
+class JobSystem;
+
+// Forward declarations
+class StaticObject;
+class GameObject;
+
+
+/// <summary>
+/// Stores the state game objects use every physics step (position, rotation, velocity, angular velocity, inverse mass, and flags)
+/// in seperate contiguous arrays. Objects read and write their state here while they are in a storage, so passes over every object
+/// read memory in order instead of following pointers. Objects are found by ID through a slot map, in constant time
+/// </summary>
+class BodyStorage
+{
+	// Objects access their own state through the arrays
+	friend StaticObject;
+	friend GameObject;
+public:
+	enum Flags : unsigned char
+	{
+		Awake = 1 << 0,
+		LockRotation = 1 << 1,
+	};
+
+
+	BodyStorage() = default;
+	~BodyStorage();
+
+	BodyStorage(const BodyStorage&) = delete;
+	BodyStorage& operator=(const BodyStorage&) = delete;
+
+
+	/// <summary>
+	/// Add an object using its ID, moving its state into the storage
+	/// </summary>
+	/// <returns>False if the ID is already used, or the object is already in a storage</returns>
+	bool add(GameObject* object);
+	// Remove an object, moving its state back into it. Needs to be called before the object is deleted
+	void remove(GameObject* object);
+	// Remove every object, moving their state back into them
+	void clear();
+
+	/// <summary>
+	/// Apply a physics step to every object in the storage. Does the same as calling GameObject::physicsStep on each object,
+	/// but moves them all at once with IntegrationKernels
+	/// </summary>
+	/// <param name="jobSystem">If not null, moving objects is split between its threads. The result is the same either way</param>
+	void integrate(float timeStep, JobSystem* jobSystem = nullptr);
+
+	// Find an object by ID. Returns nullptr if it is not in this storage
+	GameObject* find(unsigned int id) const;
+	bool contains(unsigned int id) const { return ids.contains(id); }
+	// Get the ID of the object using the same slot as an ID, which can be another generation. Returns SlotMap::invalidID if there isnt one
+	unsigned int getSlotID(unsigned int id) const { return ids.getSlotID(id); }
+
+	size_t size() const { return objects.size(); }
+	bool empty() const { return objects.empty(); }
+	// Objects are stored in the same order as their state. The order changes when objects are removed
+	GameObject* getObject(size_t index) const { return objects[index]; }
+	std::vector<GameObject*>::const_iterator begin() const { return objects.begin(); }
+	std::vector<GameObject*>::const_iterator end() const { return objects.end(); }
+
+
+private:
+	// Maps object IDs to indices in the arrays
+	SlotMap ids;
+	std::vector<GameObject*> objects;
+
+	std::vector<raylib::Vector3> positions;
+	std::vector<Quat> rotations;
+	std::vector<raylib::Vector3> velocities;
+	std::vector<raylib::Vector3> angularVelocities;
+	std::vector<float> inverseMasses;
+	std::vector<unsigned char> flags;
+
+	// Per object values used by integrate, kept so they dont need to be reallocated every step
+	std::vector<float> stepTimes;
+	std::vector<float> linearDrags;
+	std::vector<float> angularDrags;
+};
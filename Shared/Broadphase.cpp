@@ -0,0 +1,266 @@
+#include "Broadphase.h"
+#include "CollisionSystem.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+
+/// <summary>
+/// A temporary object used to test a shape against the world. Does not own its collider
+/// </summary>
+class QueryProbe : public StaticObject
+{
+public:
+	QueryProbe(const Collider& shape, const raylib::Vector3& position, const raylib::Vector3& rotation) :
+		StaticObject(position, rotation, const_cast<Collider*>(&shape))
+	{}
+	~QueryProbe()
+	{
+		// Stop the base class deleting the shape
+		collider = nullptr;
+	}
+
+	void setPosition(const raylib::Vector3& newPosition) { position() = newPosition; }
+};
+
+
+Broadphase::Broadphase(float margin) :
+	tree(margin)
+{}
+
+
+void Broadphase::addObject(GameObject* object)
+{
+	// Objects without a collider can never collide, and objects can only be added once
+	if (!object->getCollider() || object->proxyID != AABBTree::nullNode)
+	{
+		return;
+	}
+
+	object->proxyID = tree.createProxy(object->getAABB(), object);
+	dynamicObjects.push_back(object);
+}
+
+void Broadphase::removeObject(GameObject* object)
+{
+	if (object->proxyID == AABBTree::nullNode)
+	{
+		return;
+	}
+
+	tree.destroyProxy(object->proxyID);
+	object->proxyID = AABBTree::nullNode;
+
+	auto it = std::find(dynamicObjects.begin(), dynamicObjects.end(), object);
+	if (it != dynamicObjects.end())
+	{
+		// Order does not matter, so swap with the last element to avoid shifting
+		*it = dynamicObjects.back();
+		dynamicObjects.pop_back();
+	}
+}
+
+void Broadphase::buildStaticWorld(const std::vector<StaticObject*>& staticObjects)
+{
+	staticWorld.build(staticObjects);
+}
+
+void Broadphase::clear()
+{
+	// Objects may still exist, so make sure they dont think they are in the tree
+	for (unsigned int i = 0; i < dynamicObjects.size(); i++)
+	{
+		dynamicObjects[i]->proxyID = AABBTree::nullNode;
+	}
+
+	tree.clear();
+	dynamicObjects.clear();
+	staticWorld.clear();
+}
+
+
+void Broadphase::updateObjects(float predictionTime)
+{
+	for (unsigned int i = 0; i < dynamicObjects.size(); i++)
+	{
+		GameObject* object = dynamicObjects[i];
+		// Getting the box also updates the objects cached transform, so it can be read from multiple threads during the narrowphase
+		// Only reinserts the proxy if the object has left its fattened box
+		tree.moveProxy(object->proxyID, object->getAABB(), object->getVelocity() * predictionTime);
+	}
+}
+
+void Broadphase::updateObject(GameObject* object)
+{
+	if (object->proxyID == AABBTree::nullNode)
+	{
+		return;
+	}
+
+	tree.moveProxy(object->proxyID, object->getAABB(), Vector3Zero());
+}
+
+void Broadphase::findPairs(const std::function<void(GameObject*, StaticObject*)>& callback) const
+{
+	// Only game objects move, so every pair will contain at least one of them
+	for (unsigned int i = 0; i < dynamicObjects.size(); i++)
+	{
+		GameObject* object = dynamicObjects[i];
+		int proxyID = object->proxyID;
+
+		// Sleeping objects only collide with awake objects, which will find the pair themselves
+		if (!object->isAwake())
+		{
+			continue;
+		}
+
+		// Static objects. Branches without a category in the objects mask are skipped entirely
+		staticWorld.query(object->getAABB(), [&](StaticObject* other)
+		{
+			if (object->canCollideWith(other))
+			{
+				callback(object, other);
+			}
+		}, object->getCollisionMask());
+
+		// Other game objects
+		tree.query(tree.getFatAABB(proxyID), [&](int otherProxyID)
+		{
+			// Pairs of awake game objects will be found from both sides, so only use one of them
+			GameObject* other = static_cast<GameObject*>(tree.getObject(otherProxyID));
+			if ((otherProxyID > proxyID || !other->isAwake()) && object->canCollideWith(other))
+			{
+				callback(object, other);
+			}
+			return true;
+		});
+	}
+}
+
+void Broadphase::query(const AABB& aabb, const std::function<void(StaticObject*)>& callback) const
+{
+	staticWorld.query(aabb, [&](StaticObject* object)
+	{
+		callback(object);
+	});
+	tree.query(aabb, [&](int proxyID)
+	{
+		callback(tree.getObject(proxyID));
+		return true;
+	});
+}
+
+
+bool Broadphase::raycast(const RaycastQuery& ray, QueryHit& hitOut) const
+{
+	hitOut = QueryHit();
+	float closest = ray.maxDistance;
+
+	// Each hit shortens the ray, so objects further away are skipped
+	auto castAgainst = [&](StaticObject* object)
+	{
+		RaycastQuery shortenedRay = ray;
+		shortenedRay.maxDistance = closest;
+
+		QueryHit hit;
+		if (object != ray.ignoredObject && (object->getCollisionCategory() & ray.mask) != 0 && 
+			CollisionSystem::raycast(object, shortenedRay, hit) && (hitOut.object == nullptr || hit.distance < closest))
+		{
+			hitOut = hit;
+			closest = hit.distance;
+		}
+		return closest;
+	};
+
+	staticWorld.raycast(ray.origin, ray.direction, closest, castAgainst, ray.mask);
+	tree.raycast(ray.origin, ray.direction, closest, [&](int proxyID)
+	{
+		return castAgainst(tree.getObject(proxyID));
+	});
+
+	return hitOut.object != nullptr;
+}
+
+void Broadphase::raycastBatch(const std::vector<RaycastQuery>& rays, std::vector<QueryHit>& hitsOut, JobSystem* jobSystem) const
+{
+	hitsOut.assign(rays.size(), QueryHit());
+
+	if (!jobSystem)
+	{
+		for (unsigned int i = 0; i < rays.size(); i++)
+		{
+			raycast(rays[i], hitsOut[i]);
+		}
+		return;
+	}
+
+	// Transforms are cached when first used, so make sure they are up to date before reading them from multiple threads
+	for (unsigned int i = 0; i < dynamicObjects.size(); i++)
+	{
+		dynamicObjects[i]->updateTransform();
+	}
+
+	// Rays are cast in ranges of at least 32, so the cost of handing out work is small compared to the work itself
+	jobSystem->parallelForRange(rays.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			raycast(rays[i], hitsOut[i]);
+		}
+	}, 32);
+}
+
+bool Broadphase::shapeCast(const Collider& shape, const raylib::Vector3& rotation, const RaycastQuery& path, QueryHit& hitOut) const
+{
+	hitOut = QueryHit();
+	raylib::Vector3 end = Vector3Add(path.origin, Vector3Scale(path.direction, path.maxDistance));
+	QueryProbe probe(shape, end, rotation);
+
+	// Anything in the box covering the whole path could be hit
+	AABB endAABB = probe.getAABB();
+	raylib::Vector3 offset = Vector3Subtract(path.origin, end);
+	AABB sweptAABB = AABB::combine(endAABB, AABB(Vector3Add(endAABB.lower, offset), Vector3Add(endAABB.upper, offset)));
+
+	float firstImpact = 1;
+	StaticObject* firstObject = nullptr;
+	query(sweptAABB, [&](StaticObject* object)
+	{
+		float time;
+		if (object != path.ignoredObject && (object->getCollisionCategory() & path.mask) != 0 &&
+			CollisionSystem::findTimeOfImpact(&probe, path.origin, object, time) && (firstObject == nullptr || time < firstImpact))
+		{
+			firstImpact = time;
+			firstObject = object;
+		}
+	});
+
+	if (!firstObject)
+	{
+		return false;
+	}
+
+	// Find where the shape is touching the object it hit
+	probe.setPosition(Vector3Lerp(path.origin, end, firstImpact));
+	Contact contact;
+	CollisionSystem::findContact(&probe, firstObject, contact);
+
+	hitOut.object = firstObject;
+	hitOut.point = contact.point;
+	// The contact normal points from the shape to the object
+	hitOut.normal = Vector3Negate(contact.normal);
+	hitOut.distance = path.maxDistance * firstImpact;
+	return true;
+}
+
+void Broadphase::overlap(const Collider& shape, const raylib::Vector3& position, const raylib::Vector3& rotation, std::vector<StaticObject*>& objectsOut, unsigned int mask) const
+{
+	QueryProbe probe(shape, position, rotation);
+
+	query(probe.getAABB(), [&](StaticObject* object)
+	{
+		Contact contact;
+		if ((object->getCollisionCategory() & mask) != 0 && CollisionSystem::findContact(&probe, object, contact))
+		{
+			objectsOut.push_back(object);
+		}
+	});
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "AABBTree.h"
+#include "StaticWorld.h"
+#include "Query.h"
+#include <functional>
+
+// Forward declarations
+class GameObject;
+class Collider;
+class JobSystem;
+
+
+/// <summary>
+/// Finds pairs of objects that might be colliding, so only those need to be checked by CollisionSystem. 
+/// Game objects are kept in a dynamic tree, and static objects in a StaticWorld that is built once
+/// </summary>
+class Broadphase
+{
+public:
+	Broadphase(float margin = 0.1f);
+
+
+	// Add a game object to the broadphase. Objects without a collider are ignored
+	void addObject(GameObject* object);
+	// Remove a game object from the broadphase. Needs to be called before the object is deleted
+	void removeObject(GameObject* object);
+	// Build the static world from every static object. Static objects never change, so this only needs to be done once
+	void buildStaticWorld(const std::vector<StaticObject*>& staticObjects);
+	// Remove every object, including static objects
+	void clear();
+
+	/// <summary>
+	/// Update the proxies of game objects that have moved outside their fattened box
+	/// </summary>
+	/// <param name="predictionTime">How far ahead to predict movement when fattening boxes</param>
+	void updateObjects(float predictionTime);
+	// Update the proxy of a single game object that has been moved outside of a physics step
+	void updateObject(GameObject* object);
+
+	/// <summary>
+	/// Call callback once for every pair of objects whose boxes overlap. The first object will always be an awake game object,
+	/// and pairs where neither object is awake, or whose collision filters dont match, are skipped
+	/// </summary>
+	void findPairs(const std::function<void(GameObject*, StaticObject*)>& callback) const;
+	/// <summary>
+	/// Call callback for every object whose box overlaps aabb
+	/// </summary>
+	void query(const AABB& aabb, const std::function<void(StaticObject*)>& callback) const;
+
+	/// <summary>
+	/// Find the closest object hit by a ray
+	/// </summary>
+	/// <returns>True if something was hit, with hitOut set</returns>
+	bool raycast(const RaycastQuery& ray, QueryHit& hitOut) const;
+	/// <summary>
+	/// Find the closest object hit by each ray. Rays are independent, so they can be split between threads
+	/// </summary>
+	/// <param name="hitsOut">Replaced with a hit for each ray, in the same order. Rays that hit nothing have a null object</param>
+	/// <param name="jobSystem">Used to cast rays in parallel. If null, every ray is cast on the calling thread</param>
+	void raycastBatch(const std::vector<RaycastQuery>& rays, std::vector<QueryHit>& hitsOut, JobSystem* jobSystem = nullptr) const;
+	/// <summary>
+	/// Find the first object hit by a shape moving along a ray, without rotating. Objects the shape overlaps at the start are ignored
+	/// </summary>
+	/// <param name="rotation">The rotation of the shape in euler angles</param>
+	/// <returns>True if something was hit, with hitOut set</returns>
+	bool shapeCast(const Collider& shape, const raylib::Vector3& rotation, const RaycastQuery& path, QueryHit& hitOut) const;
+	/// <summary>
+	/// Find every object overlapping a shape
+	/// </summary>
+	/// <param name="objectsOut">Overlapping objects are added to the end</param>
+	/// <param name="mask">Only objects with a collision category in the mask are found</param>
+	void overlap(const Collider& shape, const raylib::Vector3& position, const raylib::Vector3& rotation, std::vector<StaticObject*>& objectsOut, unsigned int mask = 0xFFFFFFFF) const;
+
+
+	const StaticWorld& getStaticWorld() const { return staticWorld; }
+
+
+private:
+	AABBTree tree;
+	StaticWorld staticWorld;
+	// Game objects in the tree. These are the only objects that move, so the only ones that need updating
+	std::vector<GameObject*> dynamicObjects;
+};
@@ -7,18 +7,21 @@ ClientObject::ClientObject() :
 	GameObject()
 {
 	typeID = -2;
+	canSleep = false;
 }
 
 ClientObject::ClientObject(raylib::Vector3 position, raylib::Vector3 rotation, unsigned int clientID, float mass, float elasticity, Collider* collider, float linearDrag, float angularDrag, float friction, bool lockRotation) :
 	GameObject(position, rotation, clientID, mass, elasticity, collider, linearDrag, angularDrag, friction, lockRotation)
 {
 	typeID = -2;
+	canSleep = false;
 }
 
 ClientObject::ClientObject(PhysicsState initState, unsigned int clientID, float mass, float elasticity, Collider* collider, float linearDrag, float angularDrag, float friction, bool lockRotation) :
 	GameObject(initState, clientID, mass, elasticity, collider, linearDrag, angularDrag, friction, lockRotation)
 {
 	typeID = -2;
+	canSleep = false;
 }
 
 
@@ -34,15 +37,15 @@ void ClientObject::updateStateWithInputBuffer(const PhysicsState& state, RakNet:
 
 	// Store our current state
 	PhysicsState currentState;
-	currentState.position = position;
-	currentState.rotation = rotation;
-	currentState.velocity = velocity;
-	currentState.angularVelocity = angularVelocity;
+	currentState.position = position();
+	currentState.velocity = velocity();
+	currentState.angularVelocity = angularVelocity();
+	Quat currentRotation = rotation();
 	// Apply the new state
-	position = state.position;
-	rotation = state.rotation;
-	velocity = state.velocity;
-	angularVelocity = state.angularVelocity;
+	position() = state.position;
+	rotation() = Quat::fromEuler(state.rotation);
+	velocity() = state.velocity;
+	angularVelocity() = state.angularVelocity;
 
 
 	RakNet::Time lastTime = stateTime;
@@ -71,14 +74,14 @@ void ClientObject::updateStateWithInputBuffer(const PhysicsState& state, RakNet:
 		if (isFirstInput)
 		{
 			PhysicsState inputState = std::get<1>(input);
-			if (Vector3Distance(position, inputState.position) < smooth_threshold &&
-				Vector3Distance(rotation, inputState.rotation) < smooth_threshold &&
-				Vector3Distance(velocity, inputState.velocity) < smooth_threshold)
+			if (Vector3Distance(position(), inputState.position) < smooth_threshold &&
+				Vector3Distance(getRotation(), inputState.rotation) < smooth_threshold &&
+				Vector3Distance(velocity(), inputState.velocity) < smooth_threshold)
 			{
-				position = currentState.position;
-				rotation = currentState.rotation;
-				velocity = currentState.velocity;
-				angularVelocity = currentState.angularVelocity;
+				position() = currentState.position;
+				rotation() = currentRotation;
+				velocity() = currentState.velocity;
+				angularVelocity() = currentState.angularVelocity;
 
 				// Update the absolute time for this object
 				lastPacketTime = stateTime;
@@ -91,10 +94,10 @@ void ClientObject::updateStateWithInputBuffer(const PhysicsState& state, RakNet:
 		
 		// Process and apply the input
 		PhysicsState diff = processInputMovement(std::get<2>(input));
-		position += diff.position;
-		rotation += diff.rotation;
-		velocity += diff.velocity;
-		angularVelocity += diff.angularVelocity;
+		position() += diff.position;
+		addEulerRotation(diff.rotation);
+		velocity() += diff.velocity;
+		angularVelocity() += diff.angularVelocity;
 		
 
 		lastTime = inputTime;
@@ -108,16 +111,16 @@ void ClientObject::updateStateWithInputBuffer(const PhysicsState& state, RakNet:
 	// Should the position be updated with smoothing?
 	if (useSmoothing)
 	{
-		float dist = Vector3Distance(currentState.position, position);
+		float dist = Vector3Distance(currentState.position, position());
 
 		if (dist < smooth_snapDistance && dist > smooth_threshold)
 		{
 			// Move some of the way to the new position
-			position = currentState.position + (position - currentState.position) * smooth_moveFraction;
+			position() = currentState.position + (position() - currentState.position) * smooth_moveFraction;
 		}
 		else if (dist < smooth_threshold)	// We are close, use predicted value
 		{
-			position = currentState.position;
+			position() = currentState.position;
 		}
 	}
 
@@ -1,18 +1,82 @@
 #pragma once
 #include "raylib-cpp.hpp"
+#include "PhysicsMath.h"
 #include <BitStream.h>
 
-// Forward declaration
+// Forward declarations
 class StaticObject;
+class Sphere;
+class OBB;
+
+
+/// <summary>
+/// A list of collider types, used to generate code for every shape at compile time
+/// </summary>
+template<class... Shapes>
+struct ShapeList {};
+
+// Every collider type. A shape's ID is its index in this list, so new colliders are added here, 
+// with a CollisionTest for each shape they can collide with
+typedef ShapeList<Sphere, OBB> ColliderShapes;
+
+
+// The index of a shape in a list
+template<class Shape, class List>
+struct ShapeIndex;
+template<class Shape, class... Rest>
+struct ShapeIndex<Shape, ShapeList<Shape, Rest...>>
+{
+	static const int value = 0;
+};
+template<class Shape, class First, class... Rest>
+struct ShapeIndex<Shape, ShapeList<First, Rest...>>
+{
+	static const int value = 1 + ShapeIndex<Shape, ShapeList<Rest...>>::value;
+};
+
+// The shape at an index in a list
+template<size_t Index, class List>
+struct ShapeAt;
+template<class First, class... Rest>
+struct ShapeAt<0, ShapeList<First, Rest...>>
+{
+	typedef First type;
+};
+template<size_t Index, class First, class... Rest>
+struct ShapeAt<Index, ShapeList<First, Rest...>>
+{
+	typedef typename ShapeAt<Index - 1, ShapeList<Rest...>>::type type;
+};
+
+// The number of shapes in a list
+template<class List>
+struct ShapeCount;
+template<class... Shapes>
+struct ShapeCount<ShapeList<Shapes...>>
+{
+	static const int value = sizeof...(Shapes);
+};
+
+// The shape ID of a collider type
+template<class Shape>
+struct ShapeID : ShapeIndex<Shape, ColliderShapes> {};
 
 
 class Collider
 {
 public:
 	// Calculate the moment of inertia tensor of an object with this colliders shape
-	virtual raylib::Matrix calculateInertiaTensor(float mass) const = 0;
+	virtual Mat3 calculateInertiaTensor(float mass) const = 0;
 	// Get radius of a sphere containing this collider
 	virtual float getBoundingSphereRadius() const = 0;
+	// Get radius of the largest sphere that fits inside this collider. Moving less than this can not skip over anything
+	virtual float getInnerRadius() const = 0;
+	// Get the half extents of a world space box containing this collider, when rotated to the given axes
+	virtual raylib::Vector3 getWorldExtents(const raylib::Vector3 axes[3]) const
+	{
+		float radius = getBoundingSphereRadius();
+		return raylib::Vector3(radius, radius, radius);
+	}
 
 protected:
 	// Used by StaticObject.serialize to write its collider. Because 
@@ -28,5 +92,5 @@ public:
 	int getShapeID() const { return shapeID; }
 
 	// The total number of shape IDs in use
-	static const int SHAPE_COUNT = 2;
+	static const int SHAPE_COUNT = ShapeCount<ColliderShapes>::value;
 };
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+#include "CollisionSystem.h"
+#include <utility>
+
+
+// Checks for a collision between two objects, filling in contactOut if they are colliding
+typedef bool(*CollisionFunction)(const StaticObject*, const StaticObject*, Contact&);
+// Checks if a ray hits an object, filling in hitOut if it does
+typedef bool(*RaycastFunction)(const StaticObject*, const RaycastQuery&, QueryHit&);
+
+
+/// <summary>
+/// The collision test for a pair of shapes. Specialise it for each pair that can collide, setting isDefined to true and adding
+/// static bool test(const StaticObject* obj1, const Shape1& shape1, const StaticObject* obj2, const Shape2& shape2, Contact& contactOut).
+/// Each pair only needs to be written in one order, as the mirrored pair is generated from it
+/// </summary>
+template<class Shape1, class Shape2>
+struct CollisionTest
+{
+	static const bool isDefined = false;
+};
+
+
+/// <summary>
+/// Chooses the collision function for a pair of shapes. Uses the mirrored test if only that one is defined, or null if neither are
+/// </summary>
+template<class Shape1, class Shape2, bool isDefined = CollisionTest<Shape1, Shape2>::isDefined, bool isMirrorDefined = CollisionTest<Shape2, Shape1>::isDefined>
+struct CollisionDispatch
+{
+	static constexpr CollisionFunction get() { return nullptr; }
+};
+
+template<class Shape1, class Shape2, bool isMirrorDefined>
+struct CollisionDispatch<Shape1, Shape2, true, isMirrorDefined>
+{
+	static bool collide(const StaticObject* obj1, const StaticObject* obj2, Contact& contactOut)
+	{
+		// The table is indexed by shape ID, so the colliders are known to be these types
+		return CollisionTest<Shape1, Shape2>::test(obj1, static_cast<const Shape1&>(*obj1->getCollider()), 
+												   obj2, static_cast<const Shape2&>(*obj2->getCollider()), contactOut);
+	}
+
+	static constexpr CollisionFunction get() { return &collide; }
+};
+
+template<class Shape1, class Shape2>
+struct CollisionDispatch<Shape1, Shape2, false, true>
+{
+	static bool collide(const StaticObject* obj1, const StaticObject* obj2, Contact& contactOut)
+	{
+		bool isColliding = CollisionTest<Shape2, Shape1>::test(obj2, static_cast<const Shape2&>(*obj2->getCollider()), 
+															   obj1, static_cast<const Shape1&>(*obj1->getCollider()), contactOut);
+		// Reverse the normal so it is relitive to obj1
+		contactOut.normal = Vector3Negate(contactOut.normal);
+		return isColliding;
+	}
+
+	static constexpr CollisionFunction get() { return &collide; }
+};
+
+
+/// <summary>
+/// The collision function for every pair of shapes in a list, built at compile time
+/// </summary>
+template<class List, class Indices = std::make_index_sequence<ShapeCount<List>::value * ShapeCount<List>::value>>
+struct CollisionTable;
+
+template<class List, size_t... Indices>
+struct CollisionTable<List, std::index_sequence<Indices...>>
+{
+	static const int shapeCount = ShapeCount<List>::value;
+	// Indexed by shapeID1 * shapeCount + shapeID2
+	static const CollisionFunction functions[sizeof...(Indices)];
+
+	// Get the function for a pair of shape IDs, or null if they cant collide
+	static CollisionFunction get(int shapeID1, int shapeID2) { return functions[shapeID1 * shapeCount + shapeID2]; }
+};
+
+template<class List, size_t... Indices>
+const CollisionFunction CollisionTable<List, std::index_sequence<Indices...>>::functions[sizeof...(Indices)] =
+{
+	CollisionDispatch<typename ShapeAt<Indices / ShapeCount<List>::value, List>::type, 
+					  typename ShapeAt<Indices % ShapeCount<List>::value, List>::type>::get()...
+};
+
+
+/// <summary>
+/// The raycast for a shape. Specialise it for each shape, setting isDefined to true and adding
+/// static bool test(const StaticObject* object, const Shape& shape, const RaycastQuery& ray, QueryHit& hitOut)
+/// </summary>
+template<class Shape>
+struct RaycastTest
+{
+	static const bool isDefined = false;
+};
+
+// Chooses the raycast function for a shape, or null if it doesnt have one
+template<class Shape, bool isDefined = RaycastTest<Shape>::isDefined>
+struct RaycastDispatch
+{
+	static constexpr RaycastFunction get() { return nullptr; }
+};
+
+template<class Shape>
+struct RaycastDispatch<Shape, true>
+{
+	static bool cast(const StaticObject* object, const RaycastQuery& ray, QueryHit& hitOut)
+	{
+		return RaycastTest<Shape>::test(object, static_cast<const Shape&>(*object->getCollider()), ray, hitOut);
+	}
+
+	static constexpr RaycastFunction get() { return &cast; }
+};
+
+/// <summary>
+/// The raycast function for every shape in a list, built at compile time
+/// </summary>
+template<class List>
+struct RaycastTable;
+
+template<class... Shapes>
+struct RaycastTable<ShapeList<Shapes...>>
+{
+	// Indexed by shape ID
+	static const RaycastFunction functions[sizeof...(Shapes)];
+
+	// Get the function for a shape ID, or null if it cant be raycast against
+	static RaycastFunction get(int shapeID) { return functions[shapeID]; }
+};
+
+template<class... Shapes>
+const RaycastFunction RaycastTable<ShapeList<Shapes...>>::functions[sizeof...(Shapes)] =
+{
+	RaycastDispatch<Shapes>::get()...
+};
@@ -1,393 +1,531 @@
 #include "CollisionSystem.h"
+#include "CollisionDispatch.h"
 #include "Sphere.h"
 #include "OBB.h"
+#include "JobSystem.h"
+#include <algorithm>
 
 
-struct Interval
-{
-	float min = INFINITY, max = -INFINITY;
-};
+// The most points clipping a box face against another can produce
+const int maxClipPoints = 8;
 
-struct Line
-{
-	raylib::Vector3 start, end;
-};
 
-struct Plane
+// Get half the length of a box projected onto an axis
+float getProjectedRadius(const raylib::Vector3 axes[3], const float extents[3], const raylib::Vector3& axis)
 {
-	raylib::Vector3 normal;
-	float distance = 0;
-};
-
+	return extents[0] * fabsf(Vector3DotProduct(axes[0], axis)) +
+		   extents[1] * fabsf(Vector3DotProduct(axes[1], axis)) +
+		   extents[2] * fabsf(Vector3DotProduct(axes[2], axis));
+}
 
-std::vector<raylib::Vector3> getVertices(const StaticObject& obb)
+/// <summary>
+/// Clip a convex polygon so only the part where dot(normal, point) &lt;= distance is kept
+/// </summary>
+/// <param name="polygonOut">Needs room for one more point than the input polygon</param>
+/// <returns>The number of points in polygonOut</returns>
+int clipPolygon(const raylib::Vector3* polygon, int count, const raylib::Vector3& normal, float distance, raylib::Vector3* polygonOut)
 {
-	raylib::Vector3 center = obb.getPosition();
-	raylib::Vector3 extents = ((OBB*)obb.getCollider())->getHalfExtents();
-	raylib::Matrix rot = MatrixRotateXYZ(obb.getRotation());
-	// Determine the rotated axes of the box
-	raylib::Vector3 axes[] =
-	{
-		raylib::Vector3(rot.m0, rot.m1, rot.m2),
-		raylib::Vector3(rot.m4, rot.m5, rot.m6),
-		raylib::Vector3(rot.m8, rot.m9, rot.m10),
-	};
-
-
-	std::vector<raylib::Vector3> result;
-	result.resize(8);
+	int countOut = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const raylib::Vector3& a = polygon[i];
+		const raylib::Vector3& b = polygon[(i + 1) % count];
+		float distanceA = Vector3DotProduct(normal, a) - distance;
+		float distanceB = Vector3DotProduct(normal, b) - distance;
 
-	// Calculate the 8 corners
-	result[0] = center + axes[0] * extents.x + axes[1] * extents.y + axes[2] * extents.z;
-	result[1] = center - axes[0] * extents.x + axes[1] * extents.y + axes[2] * extents.z;
-	result[2] = center + axes[0] * extents.x - axes[1] * extents.y + axes[2] * extents.z;
-	result[3] = center + axes[0] * extents.x + axes[1] * extents.y - axes[2] * extents.z;
-	result[4] = center - axes[0] * extents.x - axes[1] * extents.y - axes[2] * extents.z;
-	result[5] = center + axes[0] * extents.x - axes[1] * extents.y - axes[2] * extents.z;
-	result[6] = center - axes[0] * extents.x + axes[1] * extents.y - axes[2] * extents.z;
-	result[7] = center - axes[0] * extents.x - axes[1] * extents.y + axes[2] * extents.z;
+		// Keep points inside the plane
+		if (distanceA <= 0)
+		{
+			polygonOut[countOut++] = a;
+		}
+		// If the edge crosses the plane, add the point where it crosses
+		if ((distanceA < 0 && distanceB > 0) || (distanceA > 0 && distanceB < 0))
+		{
+			polygonOut[countOut++] = Vector3Lerp(a, b, distanceA / (distanceA - distanceB));
+		}
+	}
 
-	return result;
+	return countOut;
 }
 
-std::vector<Line> getEdges(const StaticObject& obb)
+// Signed area of the triangle abc when looking down the normal
+float getSignedArea(const raylib::Vector3& a, const raylib::Vector3& b, const raylib::Vector3& c, const raylib::Vector3& normal)
 {
-	std::vector<raylib::Vector3> corners = getVertices(obb);
-
-	std::vector<Line> result;
-	result.reserve(12);
-
-	// Each edge is two connected corners
-	result.push_back({ corners[6], corners[1] });
-	result.push_back({ corners[6], corners[3] });
-	result.push_back({ corners[6], corners[4] });
-	result.push_back({ corners[2], corners[7] });
-	result.push_back({ corners[2], corners[5] });
-	result.push_back({ corners[2], corners[0] });
-	result.push_back({ corners[0], corners[1] });
-	result.push_back({ corners[0], corners[3] });
-	result.push_back({ corners[7], corners[1] });
-	result.push_back({ corners[7], corners[4] });
-	result.push_back({ corners[4], corners[5] });
-	result.push_back({ corners[5], corners[3] });
-
-	return result;
+	return Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a)), normal);
 }
 
-
-Interval getInterval(const StaticObject& obb, const raylib::Vector3& axis)
+// Choose which contact points to keep. The deepest point is always kept, then the points covering the largest area
+void reduceContactPoints(const raylib::Vector3* points, const float* penetrations, int count, const raylib::Vector3& normal, Contact& contactOut)
 {
-	// Get each corner of the box
-	std::vector<raylib::Vector3> vertex = getVertices(obb);
-
-	Interval result;
-
-	// Project each corner onto the axis to find the min and max lengths
-	for (unsigned short i = 0; i < 8; i++)
+	contactOut.pointCount = 0;
+	if (count <= Contact::maxPoints)
 	{
-		float projection = Vector3DotProduct(axis, vertex[i]);
-		result.min = (projection < result.min) ? projection : result.min;
-		result.max = (projection > result.max) ? projection : result.max;
+		for (int i = 0; i < count; i++)
+		{
+			contactOut.points[i] = points[i];
+			contactOut.penetrations[i] = penetrations[i];
+		}
+		contactOut.pointCount = count;
+		return;
 	}
 
-	return result;
-}
-
-float penetrationDepth(const StaticObject& obb1, const StaticObject& obb2, const raylib::Vector3& axis, bool& outShouldFlip)
-{
-	// Project both boxes along the axis
-	Interval i1 = getInterval(obb1, Vector3Normalize(axis));
-	Interval i2 = getInterval(obb2, Vector3Normalize(axis));
+	int chosen[Contact::maxPoints];
 
-	// There is no overlap
-	if (!((i2.min <= i1.max) && (i1.min <= i2.max)))
+	// Deepest point
+	chosen[0] = 0;
+	for (int i = 1; i < count; i++)
 	{
-		return 0;
+		if (penetrations[i] > penetrations[chosen[0]])
+		{
+			chosen[0] = i;
+		}
 	}
 
-	// Find the length of each projection
-	float len1 = i1.max - i1.min;
-	float len2 = i2.max - i2.min;
-	// Find the length of both projections combined
-	float min = fminf(i1.min, i2.min);
-	float max = fmaxf(i1.max, i2.max);
-	float combinedLen = max - min;
-
-
-	outShouldFlip = (i2.min < i1.min);
-	
-	// Overlap = total length - combined length
-	return (len1 + len2) - combinedLen;
-}
-
-
-std::vector<raylib::Vector3> clipEdgesToOBB(const std::vector<Line>& edges, const StaticObject& obb)
-{
-	raylib::Vector3 obbPosition = obb.getPosition();
-	raylib::Matrix rot = MatrixRotateXYZ(obb.getRotation());
-	// Determine the rotated axes of the box
-	raylib::Vector3 axes[] =
-	{
-		raylib::Vector3(rot.m0, rot.m1, rot.m2),
-		raylib::Vector3(rot.m4, rot.m5, rot.m6),
-		raylib::Vector3(rot.m8, rot.m9, rot.m10),
-	};
-	// Get extents as an array
-	raylib::Vector3 extents = ((OBB*)obb.getCollider())->getHalfExtents();
-	float extentsArr[] = { extents.x, extents.y, extents.z };
-
-	// Determine the 6 faces of the obb
-	std::vector<Plane> planes;
-	planes.resize(6);
-	planes[0] = { axes[0], Vector3DotProduct(axes[0], (obbPosition + axes[0] * extents.x)) };
-	planes[1] = { axes[0] * -1.0f, -Vector3DotProduct(axes[0], (obbPosition - axes[0] * extents.x)) };
-	planes[2] = { axes[1], Vector3DotProduct(axes[1], (obbPosition + axes[1] * extents.y)) };
-	planes[3] = { axes[1] * -1.0f, -Vector3DotProduct(axes[1], (obbPosition - axes[1] * extents.y)) };
-	planes[4] = { axes[2], Vector3DotProduct(axes[2], (obbPosition + axes[2] * extents.z)) };
-	planes[5] = { axes[2] * -1.0f, -Vector3DotProduct(axes[2], (obbPosition - axes[2] * extents.z)) };
-	
-
-	std::vector<raylib::Vector3> result;
-	result.reserve(edges.size() * 3);
-
-	// Clip every edge to every plane, and if they intersect, keep it
-	for (unsigned short i = 0; i < planes.size(); i++)
+	// Point furthest from the first
+	chosen[1] = chosen[0];
+	float bestDistance = -1;
+	for (int i = 0; i < count; i++)
 	{
-		for (unsigned short j = 0; j < edges.size(); j++)
+		float distance = Vector3LengthSqr(Vector3Subtract(points[i], points[chosen[0]]));
+		if (distance > bestDistance)
 		{
-			raylib::Vector3 ab = Vector3Subtract(edges[j].end, edges[j].start);
-
-			float nA = Vector3DotProduct(planes[i].normal, edges[j].start);
-			float nAB = Vector3DotProduct(planes[i].normal, ab);
+			bestDistance = distance;
+			chosen[1] = i;
+		}
+	}
 
-			if (nAB == 0)
-			{
-				continue;
-			}
+	// Point making the largest triangle with the first two. Its sign gives the winding of the triangle
+	chosen[2] = chosen[0];
+	float bestArea = 0;
+	for (int i = 0; i < count; i++)
+	{
+		float area = getSignedArea(points[chosen[0]], points[chosen[1]], points[i], normal);
+		if (fabsf(area) > fabsf(bestArea))
+		{
+			bestArea = area;
+			chosen[2] = i;
+		}
+	}
+	float winding = bestArea < 0 ? -1.0f : 1.0f;
 
-			float t = (planes[i].distance - nA) / nAB;
-			if (t >= 0 && t <= 1)
+	// Point outside the triangle that adds the most area to it
+	chosen[3] = -1;
+	float bestAddedArea = 0;
+	for (int i = 0; i < count; i++)
+	{
+		for (int edge = 0; edge < 3; edge++)
+		{
+			const raylib::Vector3& a = points[chosen[edge]];
+			const raylib::Vector3& b = points[chosen[(edge + 1) % 3]];
+			float addedArea = -getSignedArea(a, b, points[i], normal) * winding;
+			if (addedArea > bestAddedArea)
 			{
-				// Find the point where the edge intersects the plane, and get it in local space
-				raylib::Vector3 intersection = Vector3Add(edges[j].start, ab * t);
-				raylib::Vector3 localPos = intersection - obbPosition;
-
-				bool isInside = true;
-				for (int i = 0; i < 3; i++)
-				{
-					// Find the distance along each axis, and if its larger than the extents, its outside
-					float distance = Vector3DotProduct(localPos, axes[i]);
-					if (distance > extentsArr[i] || distance < -extentsArr[i])
-					{
-						isInside = false;
-						break;
-					}
-				}
-
-				// The point is within all extents, so its inside the box
-				if (isInside)
-				{
-					result.push_back(intersection);
-				}
+				bestAddedArea = addedArea;
+				chosen[3] = i;
 			}
 		}
 	}
 
-	return result;
+	int chosenCount = chosen[3] < 0 ? 3 : 4;
+	for (int i = 0; i < chosenCount; i++)
+	{
+		contactOut.points[i] = points[chosen[i]];
+		contactOut.penetrations[i] = penetrations[chosen[i]];
+	}
+	contactOut.pointCount = chosenCount;
 }
 
 
 
-bool Sphere2Sphere(StaticObject* obj1, StaticObject* obj2, raylib::Vector3& collisionNormalOut, raylib::Vector3& collisionPointOut, float& penOut)
+template<>
+struct CollisionTest<Sphere, Sphere>
 {
-	float radius1 = static_cast<Sphere*>(obj1->getCollider())->getRadius();
-	float radius2 = static_cast<Sphere*>(obj2->getCollider())->getRadius();
+	static const bool isDefined = true;
+	static bool test(const StaticObject* obj1, const Sphere& sphere1, const StaticObject* obj2, const Sphere& sphere2, Contact& contactOut);
+};
+bool CollisionTest<Sphere, Sphere>::test(const StaticObject* obj1, const Sphere& sphere1, const StaticObject* obj2, const Sphere& sphere2, Contact& contactOut)
+{
+	float radius1 = sphere1.getRadius();
+	float radius2 = sphere2.getRadius();
 
 	float dist = Vector3Distance(obj1->getPosition(), obj2->getPosition());
-	penOut = (radius1 + radius2) - dist;
+	contactOut.penetration = (radius1 + radius2) - dist;
 
 	// If the penetration is positive, a collision has occured
-	if (penOut > 0)
+	if (contactOut.penetration > 0)
 	{
 		// Find the collision normal relitive to obj1
-		collisionNormalOut = Vector3Normalize(obj2->getPosition() - obj1->getPosition());
-		collisionPointOut = (obj1->getPosition() + obj2->getPosition()) * 0.5f;
+		contactOut.normal = Vector3Normalize(obj2->getPosition() - obj1->getPosition());
+		contactOut.point = (obj1->getPosition() + obj2->getPosition()) * 0.5f;
 
 		return true;
 	}
 
 	return false;
 }
-bool Sphere2Box(StaticObject* obj1, StaticObject* obj2, raylib::Vector3& collisionNormalOut, raylib::Vector3& collisionPointOut, float& penOut)
+
+template<>
+struct CollisionTest<Sphere, OBB>
+{
+	static const bool isDefined = true;
+	static bool test(const StaticObject* obj1, const Sphere& sphere, const StaticObject* obj2, const OBB& box, Contact& contactOut);
+};
+bool CollisionTest<Sphere, OBB>::test(const StaticObject* obj1, const Sphere& sphere, const StaticObject* obj2, const OBB& box, Contact& contactOut)
 {
-	float radius = static_cast<Sphere*>(obj1->getCollider())->getRadius();
-	raylib::Vector3 extents = static_cast<OBB*>(obj2->getCollider())->getHalfExtents();
-	raylib::Matrix rotationMat = MatrixRotateXYZ(obj2->getRotation());
+	float radius = sphere.getRadius();
+	raylib::Vector3 extents = box.getHalfExtents();
+	const raylib::Vector3* axes = obj2->getTransform().axes;
 
 
 	// Get the spheres position in the boxes local space
-	raylib::Vector3 localPos = obj1->getPosition() - obj2->getPosition();
-	localPos = localPos.Transform(rotationMat);
+	raylib::Vector3 offset = obj1->getPosition() - obj2->getPosition();
 
 	// Find the closest point on the box to the sphere
-	raylib::Vector3 closestPoint = localPos;
-	closestPoint.x = Clamp(closestPoint.x, -extents.x, extents.x);
-	closestPoint.y = Clamp(closestPoint.y, -extents.y, extents.y);
-	closestPoint.z = Clamp(closestPoint.z, -extents.z, extents.z);
+	raylib::Vector3 closestPoint;
+	closestPoint.x = Clamp(Vector3DotProduct(offset, axes[0]), -extents.x, extents.x);
+	closestPoint.y = Clamp(Vector3DotProduct(offset, axes[1]), -extents.y, extents.y);
+	closestPoint.z = Clamp(Vector3DotProduct(offset, axes[2]), -extents.z, extents.z);
 
 	// Transform the closest point to world space
-	closestPoint = closestPoint.Transform(rotationMat.Transpose());
+	closestPoint = Vector3Add(Vector3Add(Vector3Scale(axes[0], closestPoint.x), Vector3Scale(axes[1], closestPoint.y)), Vector3Scale(axes[2], closestPoint.z));
 	closestPoint += obj2->getPosition();
 
 
 	// Get the point relitive to the sphere
 	raylib::Vector3 closestPointOnSphere = obj1->getPosition() - closestPoint;
 
-	penOut = radius - closestPointOnSphere.Length();
-	if (penOut > 0)
+	contactOut.penetration = radius - closestPointOnSphere.Length();
+	if (contactOut.penetration > 0)
 	{
-		collisionNormalOut = -closestPointOnSphere.Normalize();
-		collisionPointOut = closestPoint;
+		contactOut.normal = -closestPointOnSphere.Normalize();
+		contactOut.point = closestPoint;
 		return true;
 	}
 
 	return false;
 }
-bool Box2Sphere(StaticObject* obj1, StaticObject* obj2, raylib::Vector3& collisionNormalOut, raylib::Vector3& collisionPointOut, float& penOut)
+
+template<>
+struct CollisionTest<OBB, OBB>
 {
-	bool res = Sphere2Box(obj2, obj1, collisionNormalOut, collisionPointOut, penOut);
-	// Reverse the normal
-	collisionNormalOut = -collisionNormalOut;
-	return res;
-}
-bool Box2Box(StaticObject* obj1, StaticObject* obj2, raylib::Vector3& collisionNormalOut, raylib::Vector3& collisionPointOut, float& penOut)
+	static const bool isDefined = true;
+	static bool test(const StaticObject* obj1, const OBB& box1, const StaticObject* obj2, const OBB& box2, Contact& contactOut);
+};
+bool CollisionTest<OBB, OBB>::test(const StaticObject* obj1, const OBB& box1, const StaticObject* obj2, const OBB& box2, Contact& contactOut)
 {
-	// Set default values for output
-	collisionPointOut = Vector3Zero();
-	penOut = INFINITY;
-
-	raylib::Matrix rot1 = MatrixRotateXYZ(obj1->getRotation());
-	raylib::Matrix rot2 = MatrixRotateXYZ(obj2->getRotation());
-
-	// The axes to test for seperation
-	raylib::Vector3 test[15] = 
-	{
-		raylib::Vector3(rot1.m0, rot1.m1, rot1.m2),
-		raylib::Vector3(rot1.m4, rot1.m5, rot1.m6),
-		raylib::Vector3(rot1.m8, rot1.m9, rot1.m10),
-		raylib::Vector3(rot2.m0, rot2.m1, rot2.m2),
-		raylib::Vector3(rot2.m4, rot2.m5, rot2.m6),
-		raylib::Vector3(rot2.m8, rot2.m9, rot2.m10)
-	};
-	// Edge axes are cross products between each face
-	for (unsigned short i = 0; i < 3; i++)
-	{
-		test[6 + i * 3 + 0] = Vector3CrossProduct(test[i], test[3]);
-		test[6 + i * 3 + 1] = Vector3CrossProduct(test[i], test[4]);
-		test[6 + i * 3 + 2] = Vector3CrossProduct(test[i], test[5]);
-	}
+	const raylib::Vector3* axes1 = obj1->getTransform().axes;
+	const raylib::Vector3* axes2 = obj2->getTransform().axes;
 
+	raylib::Vector3 halfExtents1 = box1.getHalfExtents();
+	raylib::Vector3 halfExtents2 = box2.getHalfExtents();
+	float extents1[] = { halfExtents1.x, halfExtents1.y, halfExtents1.z };
+	float extents2[] = { halfExtents2.x, halfExtents2.y, halfExtents2.z };
 
-	bool shouldFlip;
-	
-	for (unsigned short i = 0; i < 15; i++)
-	{
-		// If a test axis is close to 0, skip it
-		if (test[i].x < 0.000001f) test[i].x = 0;
-		if (test[i].y < 0.000001f) test[i].y = 0;
-		if (test[i].z < 0.000001f) test[i].z = 0;
-		if (Vector3LengthSqr(test[i]) < 0.001f)
-		{
-			continue;
-		}
+	raylib::Vector3 position1 = obj1->getPosition();
+	raylib::Vector3 position2 = obj2->getPosition();
+	raylib::Vector3 offset = Vector3Subtract(position2, position1);
 
 
-		// Get the penetration along the axis
-		float pen = penetrationDepth(*obj1, *obj2, test[i], shouldFlip);
+	// Test the 6 face axes for seperation, keeping the axis of least penetration
+	float minPen = INFINITY;
+	int bestAxis = -1;
+	raylib::Vector3 normal;
+	for (int i = 0; i < 6; i++)
+	{
+		const raylib::Vector3& axis = i < 3 ? axes1[i] : axes2[i - 3];
+		float pen = getProjectedRadius(axes1, extents1, axis) + getProjectedRadius(axes2, extents2, axis) - fabsf(Vector3DotProduct(offset, axis));
+
 		// Found a seperating axis, exit
 		if (pen <= 0)
 		{
 			return false;
 		}
+		if (pen < minPen)
+		{
+			minPen = pen;
+			bestAxis = i;
+			normal = axis;
+		}
+	}
 
-		// Keep track of the axis of min penetration
-		else if (pen < penOut)
+	// Test the 9 edge axes, which are cross products between each face
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
 		{
-			if (shouldFlip)
+			raylib::Vector3 axis = Vector3CrossProduct(axes1[i], axes2[j]);
+			float lengthSqr = Vector3LengthSqr(axis);
+			// Parallel edges are already covered by the face axes
+			if (lengthSqr < 0.0001f)
+			{
+				continue;
+			}
+			axis = Vector3Scale(axis, 1.0f / sqrtf(lengthSqr));
+
+			float pen = getProjectedRadius(axes1, extents1, axis) + getProjectedRadius(axes2, extents2, axis) - fabsf(Vector3DotProduct(offset, axis));
+			if (pen <= 0)
 			{
-				test[i] = -test[i];
+				return false;
+			}
+			// Faces are prefered unless an edge is clearly better, so boxes resting on each other keep stable contacts
+			if (pen < minPen * 0.95f)
+			{
+				minPen = pen;
+				bestAxis = 6 + i * 3 + j;
+				normal = axis;
 			}
-			penOut = pen;
-			collisionNormalOut = test[i];
 		}
 	}
 
-
-	raylib::Vector3 axis = collisionNormalOut.Normalize();
-
-	// Get contact points
-	std::vector<raylib::Vector3> contacts;
+	// Make the normal point from obj1 to obj2
+	if (Vector3DotProduct(offset, normal) < 0)
 	{
-		// Clip both boxes to each other to find contact points
-		std::vector<raylib::Vector3> c1 = clipEdgesToOBB(getEdges(*obj2), *obj1);
-		std::vector<raylib::Vector3> c2 = clipEdgesToOBB(getEdges(*obj1), *obj2);
-		// Add all contact points to a single vector
-		contacts.reserve(c1.size() + c2.size());
-		contacts.insert(contacts.end(), c1.begin(), c1.end());
-		contacts.insert(contacts.end(), c2.begin(), c2.end());
+		normal = Vector3Negate(normal);
 	}
+	contactOut.normal = normal;
+	contactOut.penetration = minPen;
 
-	Interval i = getInterval(*obj1, axis);
-	float distance = (i.max - i.min) * 0.5f - penOut * 0.5f;
-	raylib::Vector3 pointOnPlane = obj1->getPosition() + axis * distance;
 
-	for (int i = contacts.size() - 1; i >= 0; i--)
+	if (bestAxis >= 6)
 	{
-		// Move contact points to be perpendicular to the collision normal between the two objects
-		raylib::Vector3 contact = contacts[i];
-		contacts[i] = contact + (axis * Vector3DotProduct(axis, pointOnPlane - contact));
-
-		// Remove duplicate contact points
-		for (int j = contacts.size() - 1; j > i; j--)
+		// Edge contact. Find the edge of each box closest to the other box
+		int edge1 = (bestAxis - 6) / 3;
+		int edge2 = (bestAxis - 6) % 3;
+		raylib::Vector3 edgeCenter1 = position1;
+		raylib::Vector3 edgeCenter2 = position2;
+		for (int k = 0; k < 3; k++)
 		{
-			if (Vector3LengthSqr(contacts[j] - contacts[i]) < 0.0001f)
+			if (k != edge1)
+			{
+				float side = Vector3DotProduct(axes1[k], normal) > 0 ? 1.0f : -1.0f;
+				edgeCenter1 = Vector3Add(edgeCenter1, Vector3Scale(axes1[k], extents1[k] * side));
+			}
+			if (k != edge2)
 			{
-				contacts.erase(contacts.begin() + j);
-				break;
+				float side = Vector3DotProduct(axes2[k], normal) > 0 ? -1.0f : 1.0f;
+				edgeCenter2 = Vector3Add(edgeCenter2, Vector3Scale(axes2[k], extents2[k] * side));
 			}
 		}
+
+		// Find the closest points between the two edges
+		const raylib::Vector3& direction1 = axes1[edge1];
+		const raylib::Vector3& direction2 = axes2[edge2];
+		raylib::Vector3 between = Vector3Subtract(edgeCenter1, edgeCenter2);
+		float b = Vector3DotProduct(direction1, direction2);
+		float c = Vector3DotProduct(direction1, between);
+		float f = Vector3DotProduct(direction2, between);
+
+		float s = Clamp((b * f - c) / (1 - b * b), -extents1[edge1], extents1[edge1]);
+		float t = Clamp(f + b * s, -extents2[edge2], extents2[edge2]);
+		s = Clamp(b * t - c, -extents1[edge1], extents1[edge1]);
+
+		raylib::Vector3 closest1 = Vector3Add(edgeCenter1, Vector3Scale(direction1, s));
+		raylib::Vector3 closest2 = Vector3Add(edgeCenter2, Vector3Scale(direction2, t));
+
+		contactOut.point = Vector3Lerp(closest1, closest2, 0.5f);
+		contactOut.points[0] = contactOut.point;
+		contactOut.penetrations[0] = minPen;
+		contactOut.pointCount = 1;
+		return true;
 	}
 
 
-	
-	if (contacts.size() > 0)
+	// Face contact. The reference face belongs to the box whose axis was chosen, and the incident face is the face of the other box most facing it
+	bool isReference1 = bestAxis < 3;
+	const raylib::Vector3* refAxes = isReference1 ? axes1 : axes2;
+	const float* refExtents = isReference1 ? extents1 : extents2;
+	raylib::Vector3 refPosition = isReference1 ? position1 : position2;
+	const raylib::Vector3* incAxes = isReference1 ? axes2 : axes1;
+	const float* incExtents = isReference1 ? extents2 : extents1;
+	raylib::Vector3 incPosition = isReference1 ? position2 : position1;
+
+	int refAxis = bestAxis % 3;
+	// Normal of the reference face, pointing towards the incident box
+	raylib::Vector3 refNormal = isReference1 ? normal : Vector3Negate(normal);
+
+	int incAxis = 0;
+	float maxDot = -1;
+	for (int k = 0; k < 3; k++)
+	{
+		float dot = fabsf(Vector3DotProduct(incAxes[k], refNormal));
+		if (dot > maxDot)
+		{
+			maxDot = dot;
+			incAxis = k;
+		}
+	}
+
+	// Find the corners of the incident face
+	float incSide = Vector3DotProduct(incAxes[incAxis], refNormal) > 0 ? -1.0f : 1.0f;
+	raylib::Vector3 incCenter = Vector3Add(incPosition, Vector3Scale(incAxes[incAxis], incExtents[incAxis] * incSide));
+	raylib::Vector3 u = Vector3Scale(incAxes[(incAxis + 1) % 3], incExtents[(incAxis + 1) % 3]);
+	raylib::Vector3 v = Vector3Scale(incAxes[(incAxis + 2) % 3], incExtents[(incAxis + 2) % 3]);
+
+	raylib::Vector3 clipped[2][maxClipPoints];
+	clipped[0][0] = Vector3Add(incCenter, Vector3Add(u, v));
+	clipped[0][1] = Vector3Add(incCenter, Vector3Subtract(v, u));
+	clipped[0][2] = Vector3Subtract(incCenter, Vector3Add(u, v));
+	clipped[0][3] = Vector3Add(incCenter, Vector3Subtract(u, v));
+	int count = 4;
+	int current = 0;
+
+	// Clip the incident face to the 4 sides of the reference face
+	for (int k = 1; k < 3 && count > 0; k++)
 	{
-		// Use the average contact
-		for (unsigned short i = 0; i < contacts.size(); i++)
+		int side = (refAxis + k) % 3;
+		float center = Vector3DotProduct(refAxes[side], refPosition);
+
+		count = clipPolygon(clipped[current], count, refAxes[side], center + refExtents[side], clipped[1 - current]);
+		current = 1 - current;
+		count = clipPolygon(clipped[current], count, Vector3Negate(refAxes[side]), refExtents[side] - center, clipped[1 - current]);
+		current = 1 - current;
+	}
+
+	// Keep points that are below the reference face, moved to halfway between the two faces
+	float refDistance = Vector3DotProduct(refNormal, refPosition) + refExtents[refAxis];
+	raylib::Vector3 points[maxClipPoints];
+	float penetrations[maxClipPoints];
+	int pointCount = 0;
+	for (int i = 0; i < count; i++)
+	{
+		float pen = refDistance - Vector3DotProduct(refNormal, clipped[current][i]);
+		if (pen >= 0)
 		{
-			collisionPointOut += contacts[i];
+			points[pointCount] = Vector3Add(clipped[current][i], Vector3Scale(refNormal, pen * 0.5f));
+			penetrations[pointCount] = pen;
+			pointCount++;
 		}
-		collisionPointOut /= (float)contacts.size();
 	}
-	else
+
+	// If there were no contact points, do nothing
+	if (pointCount == 0)
 	{
-		// If there were no contact points, do nothing
 		return false;
 	}
-	
-	collisionNormalOut = axis;
 
+	reduceContactPoints(points, penetrations, pointCount, refNormal, contactOut);
+
+	// Use the average contact
+	contactOut.point = Vector3Zero();
+	for (int i = 0; i < contactOut.pointCount; i++)
+	{
+		contactOut.point = Vector3Add(contactOut.point, contactOut.points[i]);
+	}
+	contactOut.point = Vector3Scale(contactOut.point, 1.0f / contactOut.pointCount);
 
 	return true;
 }
 
-// Function pointer array for handling our collisions
-typedef bool(*colFunc)(StaticObject*, StaticObject*, raylib::Vector3&, raylib::Vector3&, float&);
-colFunc collisionFunctionArray[] =
+// Collision functions for every pair of shapes, indexed by shape ID. Box to sphere is generated from sphere to box
+typedef CollisionTable<ColliderShapes> collisionFunctions;
+
+
+template<>
+struct RaycastTest<Sphere>
 {
-	Sphere2Sphere, Sphere2Box,
-	Box2Sphere, Box2Box
+	static const bool isDefined = true;
+	static bool test(const StaticObject* object, const Sphere& sphere, const RaycastQuery& ray, QueryHit& hitOut);
 };
+bool RaycastTest<Sphere>::test(const StaticObject* object, const Sphere& sphere, const RaycastQuery& ray, QueryHit& hitOut)
+{
+	float radius = sphere.getRadius();
+	raylib::Vector3 offset = Vector3Subtract(ray.origin, object->getPosition());
+
+	// Solve |offset + direction * t| = radius for t
+	float b = Vector3DotProduct(offset, ray.direction);
+	float c = Vector3DotProduct(offset, offset) - radius * radius;
+	// Outside the sphere and pointing away from it
+	if (c > 0 && b > 0)
+	{
+		return false;
+	}
+
+	float discriminant = b * b - c;
+	if (discriminant < 0)
+	{
+		return false;
+	}
+
+	// Rays starting inside the sphere hit it straight away
+	float distance = -b - sqrtf(discriminant);
+	distance = distance < 0 ? 0 : distance;
+	if (distance > ray.maxDistance)
+	{
+		return false;
+	}
+
+	hitOut.distance = distance;
+	hitOut.point = Vector3Add(ray.origin, Vector3Scale(ray.direction, distance));
+	hitOut.normal = distance > 0 ? Vector3Normalize(Vector3Subtract(hitOut.point, object->getPosition())) : Vector3Negate(ray.direction);
+	return true;
+}
+
+template<>
+struct RaycastTest<OBB>
+{
+	static const bool isDefined = true;
+	static bool test(const StaticObject* object, const OBB& box, const RaycastQuery& ray, QueryHit& hitOut);
+};
+bool RaycastTest<OBB>::test(const StaticObject* object, const OBB& box, const RaycastQuery& ray, QueryHit& hitOut)
+{
+	raylib::Vector3 halfExtents = box.getHalfExtents();
+	float extents[] = { halfExtents.x, halfExtents.y, halfExtents.z };
+	const raylib::Vector3* axes = object->getTransform().axes;
+	raylib::Vector3 offset = Vector3Subtract(ray.origin, object->getPosition());
+
+	// Slab test in the boxes local space, keeping the face the ray enters through
+	float tMin = 0;
+	float tMax = ray.maxDistance;
+	int hitAxis = -1;
+	float hitSign = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		float origin = Vector3DotProduct(offset, axes[i]);
+		float direction = Vector3DotProduct(ray.direction, axes[i]);
+
+		// Parallel to this slab, so it misses unless it starts between the faces
+		if (fabsf(direction) < 0.000001f)
+		{
+			if (fabsf(origin) > extents[i])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		float t1 = (-extents[i] - origin) / direction;
+		float t2 = (extents[i] - origin) / direction;
+		float sign = -1;
+		if (t1 > t2)
+		{
+			float temp = t1;
+			t1 = t2;
+			t2 = temp;
+			sign = 1;
+		}
+
+		if (t1 > tMin)
+		{
+			tMin = t1;
+			hitAxis = i;
+			hitSign = sign;
+		}
+		tMax = t2 < tMax ? t2 : tMax;
+		if (tMin > tMax)
+		{
+			return false;
+		}
+	}
+
+	hitOut.distance = tMin;
+	hitOut.point = Vector3Add(ray.origin, Vector3Scale(ray.direction, tMin));
+	// Rays starting inside the box dont go through a face
+	hitOut.normal = hitAxis == -1 ? Vector3Negate(ray.direction) : Vector3Scale(axes[hitAxis], hitSign);
+	return true;
+}
+
+// Raycast functions for every shape, indexed by shape ID
+typedef RaycastTable<ColliderShapes> raycastFunctions;
 
 bool doBoundingSpheresIntersect(const StaticObject* obj1, const StaticObject* obj2)
 {
@@ -402,58 +540,289 @@ bool doBoundingSpheresIntersect(const StaticObject* obj1, const StaticObject* ob
 
 
 void CollisionSystem::handleCollision(GameObject* object1, StaticObject* object2, bool shouldAffectObject2)
+{
+	Contact contact;
+	// Check if there is a collision, and resolve it if so
+	if (checkCollision(object1, object2, shouldAffectObject2, contact))
+	{
+		resolveContact(contact);
+	}
+}
+
+bool CollisionSystem::checkCollision(GameObject* object1, StaticObject* object2, bool shouldAffectObject2, Contact& contactOut)
+{
+	// If the objects are filtered out, dont check
+	if (!object1->canCollideWith(object2) || !findContact(object1, object2, contactOut))
+	{
+		return false;
+	}
+
+	contactOut.object1 = object1;
+	contactOut.object2 = object2;
+	contactOut.shouldAffectObject2 = shouldAffectObject2;
+	return true;
+}
+
+bool CollisionSystem::findContact(const StaticObject* object1, const StaticObject* object2, Contact& contactOut)
 {
 	// If one of the objects have no collider, dont check
 	if (!object1->getCollider() || !object2->getCollider())
 	{
-		return;
+		return false;
 	}
 
 	int shapeID1 = object1->getCollider()->getShapeID();
 	int shapeID2 = object2->getCollider()->getShapeID();
 
 	// An ID below 0 is invalid
-	if (shapeID1 < 0 || shapeID2 < 0)
+	if (shapeID1 < 0 || shapeID2 < 0 || shapeID1 >= Collider::SHAPE_COUNT || shapeID2 >= Collider::SHAPE_COUNT)
 	{
-		return;
+		return false;
 	}
 
 
 	// Bounding sphere test
 	if (!doBoundingSpheresIntersect(object1, object2))
 	{
-		return;
+		return false;
 	}
 
 	// Get the collision detection function
-	int funcIndex = (shapeID1 * Collider::SHAPE_COUNT) + shapeID2;
-	auto colFuncPtr = collisionFunctionArray[funcIndex];
+	CollisionFunction colFuncPtr = collisionFunctions::get(shapeID1, shapeID2);
 	if (colFuncPtr == nullptr)
 	{
-		return;
+		return false;
 	}
 
 
-	raylib::Vector3 normal, contact;
-	float pen;
-	// Check if there is a collision, and resolve it if so
-	if (colFuncPtr(object1, object2, normal, contact, pen))
+	contactOut.pointCount = 0;
+	if (!colFuncPtr(object1, object2, contactOut))
+	{
+		return false;
+	}
+
+	// Functions that only find a single point dont fill in the manifold
+	if (contactOut.pointCount == 0)
+	{
+		contactOut.points[0] = contactOut.point;
+		contactOut.penetrations[0] = contactOut.penetration;
+		contactOut.pointCount = 1;
+	}
+
+	contactOut.normal = Vector3Normalize(contactOut.normal);
+	return true;
+}
+
+bool CollisionSystem::raycast(const StaticObject* object, const RaycastQuery& ray, QueryHit& hitOut)
+{
+	if (!object->getCollider())
 	{
-		object1->resolveCollision(object2, contact, normal, shouldAffectObject2);
-		applyContactForces(object1, shouldAffectObject2 ? object2 : nullptr, normal, pen);
+		return false;
+	}
+
+	int shapeID = object->getCollider()->getShapeID();
+	if (shapeID < 0 || shapeID >= Collider::SHAPE_COUNT)
+	{
+		return false;
+	}
+
+	RaycastFunction rayFuncPtr = raycastFunctions::get(shapeID);
+	if (rayFuncPtr == nullptr || !rayFuncPtr(object, ray, hitOut))
+	{
+		return false;
 	}
+
+	hitOut.object = const_cast<StaticObject*>(object);
+	return true;
+}
+
+void CollisionSystem::checkCollisions(const std::vector<CollisionPair>& pairs, std::vector<Contact>& contactsOut, JobSystem& jobSystem)
+{
+	// Each pair gets its own slot, so threads never write to the same place. Slots without a collision keep a null object
+	contactsOut.assign(pairs.size(), Contact());
+
+	// Pairs are checked in ranges of at least 64, so the cost of handing out work is small compared to the work itself
+	jobSystem.parallelForRange(pairs.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!checkCollision(pairs[i].object1, pairs[i].object2, true, contactsOut[i]))
+			{
+				contactsOut[i].object1 = nullptr;
+			}
+		}
+	}, 64);
+
+	// Remove slots that didnt collide, keeping the order of the rest
+	contactsOut.erase(std::remove_if(contactsOut.begin(), contactsOut.end(), [](const Contact& contact) { return contact.object1 == nullptr; }), contactsOut.end());
 }
 
-void CollisionSystem::applyContactForces(StaticObject* obj1, StaticObject* obj2, raylib::Vector3 collisionNorm, float pen)
+void CollisionSystem::resolveContact(const Contact& contact, bool triggerEvents)
 {
-	// Try to cast the objects to a game object
-	GameObject* gameObj1 = dynamic_cast<GameObject*>(obj1);
-	GameObject* gameObj2 = dynamic_cast<GameObject*>(obj2);
+	// Sleeping objects are treated like static objects
+	bool shouldAffectObject2 = contact.shouldAffectObject2 && (contact.object2->isStatic() || static_cast<GameObject*>(contact.object2)->isAwake());
 
+	contact.object1->applyCollisionImpulse(contact.object2, contact.point, contact.normal, shouldAffectObject2);
+	separateContact(contact);
+
+	if (triggerEvents)
+	{
+		triggerCollisionEvents(contact);
+	}
+}
+
+void CollisionSystem::separateContact(const Contact& contact)
+{
+	// Sleeping objects are treated like static objects
+	bool shouldAffectObject2 = contact.shouldAffectObject2 && (contact.object2->isStatic() || static_cast<GameObject*>(contact.object2)->isAwake());
 
+	GameObject* object2 = shouldAffectObject2 && !contact.object2->isStatic() ? static_cast<GameObject*>(contact.object2) : nullptr;
+	applyContactForces(contact.object1, object2, contact.normal, contact.penetration);
+}
+
+void CollisionSystem::triggerCollisionEvents(const Contact& contact)
+{
+	contact.object1->onCollision(contact.object2, contact.point, contact.normal);
+	if (!contact.object2->isStatic() && contact.shouldAffectObject2)
+	{
+		static_cast<GameObject*>(contact.object2)->onCollision(contact.object1, contact.point, Vector3Negate(contact.normal));
+	}
+}
+
+bool CollisionSystem::findTimeOfImpact(StaticObject* object, const raylib::Vector3& start, const StaticObject* other, float& timeOut)
+{
+	// How many times the step the objects first touch in is halved
+	const int refineIterations = 8;
+
+	if (!object->getCollider() || !other->getCollider())
+	{
+		return false;
+	}
+
+	raylib::Vector3 end = object->position();
+	raylib::Vector3 path = Vector3Subtract(end, start);
+
+	// The objects can only touch while their boxes overlap, so only that part of the path needs checking.
+	// This keeps long paths past small objects cheap, without making the steps any longer
+	float enterTime = 0;
+	float exitTime = 1;
+	{
+		AABB endAABB = object->getAABB();
+		AABB otherAABB = other->getAABB();
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// The box moves from (end - path) to end, so it overlaps on this axis while lower + path * (t - 1) <= otherUpper and upper + path * (t - 1) >= otherLower
+			float distance = (&path.x)[axis];
+			float lower = (&endAABB.lower.x)[axis] - distance;
+			float upper = (&endAABB.upper.x)[axis] - distance;
+			float otherLower = (&otherAABB.lower.x)[axis];
+			float otherUpper = (&otherAABB.upper.x)[axis];
+			if (distance == 0)
+			{
+				if (lower > otherUpper || upper < otherLower)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			float time1 = (otherLower - upper) / distance;
+			float time2 = (otherUpper - lower) / distance;
+			float axisEnter = time1 < time2 ? time1 : time2;
+			float axisExit = time1 < time2 ? time2 : time1;
+			enterTime = axisEnter > enterTime ? axisEnter : enterTime;
+			exitTime = axisExit < exitTime ? axisExit : exitTime;
+		}
+		if (enterTime > exitTime)
+		{
+			return false;
+		}
+	}
+
+	// Check if the objects touch with the object part way along its path
+	auto isTouchingAt = [&](float time)
+	{
+		object->position() = Vector3Add(start, Vector3Scale(path, time));
+		Contact contact;
+		return findContact(object, other, contact);
+	};
+
+
+	// Objects already touching are handled by normal collision detection
+	if (isTouchingAt(0))
+	{
+		object->position() = end;
+		return false;
+	}
+
+	// Steps are never longer than the inner radius, so the object cant pass through anything between two of them
+	float overlapLength = Vector3Length(path) * (exitTime - enterTime);
+	int steps = (int)ceilf(overlapLength / object->getCollider()->getInnerRadius());
+	steps = steps < 1 ? 1 : steps;
+
+	// Step along the overlapping part of the path until they touch
+	float lastTime = enterTime;
+	for (int i = 1; i <= steps; i++)
+	{
+		float time = enterTime + (exitTime - enterTime) * i / steps;
+		if (!isTouchingAt(time))
+		{
+			lastTime = time;
+			continue;
+		}
+
+		// Narrow down when they first touched, keeping a time where they are touching so the collision is found next step
+		for (int j = 0; j < refineIterations; j++)
+		{
+			float middle = 0.5f * (lastTime + time);
+			if (isTouchingAt(middle))
+			{
+				time = middle;
+			}
+			else
+			{
+				lastTime = middle;
+			}
+		}
+
+		timeOut = time;
+		object->position() = end;
+		return true;
+	}
+
+	object->position() = end;
+	return false;
+}
+
+
+bool CollisionSystem::sweepObject(GameObject* object, const raylib::Vector3& start, const std::vector<StaticObject*>& candidates)
+{
+	float firstImpact = 1;
+	for (StaticObject* other : candidates)
+	{
+		float time;
+		if (other != object && object->canCollideWith(other) && findTimeOfImpact(object, start, other, time) && time < firstImpact)
+		{
+			firstImpact = time;
+		}
+	}
+
+	if (firstImpact >= 1)
+	{
+		return false;
+	}
+
+	object->position() = Vector3Lerp(start, object->position(), firstImpact);
+	return true;
+}
+
+
+void CollisionSystem::applyContactForces(GameObject* gameObj1, GameObject* gameObj2, raylib::Vector3 collisionNorm, float pen)
+{
 	// If no obj2 was passed, use 'infinite' mass
-	float body2Mass = gameObj2 ? gameObj2->getMass() : INT_MAX;
-	float body1Factor = body2Mass / ((gameObj1 ? gameObj1->getMass() : INT_MAX) + body2Mass);
+	float inverseMass1 = gameObj1 ? gameObj1->getInverseMass() : 0;
+	float inverseMass2 = gameObj2 ? gameObj2->getInverseMass() : 0;
+	float body1Factor = inverseMass1 / (inverseMass1 + inverseMass2);
 
 	// How much to seperate objects. Using < 1 means objects will remain slightly inside eachother, allowing better contact callbacks
 	const float seperation = 0.9f;
@@ -461,10 +830,10 @@ void CollisionSystem::applyContactForces(StaticObject* obj1, StaticObject* obj2,
 	// Apply contact forces
 	if (gameObj1)
 	{
-		gameObj1->position -= collisionNorm * pen * body1Factor * seperation;
+		gameObj1->position() -= collisionNorm * pen * body1Factor * seperation;
 	}
 	if (gameObj2)
 	{
-		gameObj2->position += collisionNorm * pen * (1 - body1Factor) * seperation;
+		gameObj2->position() += collisionNorm * pen * (1 - body1Factor) * seperation;
 	}
 }
\ No newline at end of file
@@ -1,5 +1,45 @@
 #pragma once
 #include "GameObject.h"
+#include "Query.h"
+#include <vector>
+
+// Forward declaration
+class JobSystem;
+
+
+/// <summary>
+/// Two objects that might be colliding, found by the broadphase
+/// </summary>
+struct CollisionPair
+{
+	GameObject* object1;
+	StaticObject* object2;
+};
+
+/// <summary>
+/// A collision found between two objects, kept so it can be resolved later
+/// </summary>
+struct Contact
+{
+	GameObject* object1 = nullptr;
+	StaticObject* object2 = nullptr;
+
+	// The contact point in world space. If there are multiple points, this is their average
+	raylib::Vector3 point;
+	// The collision normal relitive to object1
+	raylib::Vector3 normal;
+	float penetration = 0;
+
+	// The most points a manifold can hold
+	static const int maxPoints = 4;
+	// Every point where the objects are touching, and how far they overlap at each one
+	raylib::Vector3 points[maxPoints];
+	float penetrations[maxPoints];
+	int pointCount = 0;
+
+	// Should forces be applied to object2?
+	bool shouldAffectObject2 = true;
+};
 
 class CollisionSystem
 {
@@ -7,6 +47,53 @@ public:
 	// Check for and resolve a collision between two objects
 	static void handleCollision(GameObject* object1, StaticObject* object2, bool shouldAffectObject2);
 
+	/// <summary>
+	/// Check for a collision between two objects without resolving it
+	/// </summary>
+	/// <returns>True if the objects are colliding, with contactOut set</returns>
+	static bool checkCollision(GameObject* object1, StaticObject* object2, bool shouldAffectObject2, Contact& contactOut);
+	/// <summary>
+	/// Check for a collision between any two objects, ignoring collision filters. Only the contacts normal, points, and penetration are set
+	/// </summary>
+	static bool findContact(const StaticObject* object1, const StaticObject* object2, Contact& contactOut);
+	/// <summary>
+	/// Check if a ray hits an object, ignoring the rays mask
+	/// </summary>
+	/// <returns>True if the ray hit the object within its max distance, with hitOut set</returns>
+	static bool raycast(const StaticObject* object, const RaycastQuery& ray, QueryHit& hitOut);
+	/// <summary>
+	/// Check every pair for a collision, splitting the pairs between threads. Only reads objects, so nothing can change while it runs
+	/// </summary>
+	/// <param name="contactsOut">Replaced with a contact for every colliding pair, in the same order as pairs</param>
+	static void checkCollisions(const std::vector<CollisionPair>& pairs, std::vector<Contact>& contactsOut, JobSystem& jobSystem);
+	/// <summary>
+	/// Resolve a collision found with checkCollision
+	/// </summary>
+	/// <param name="triggerEvents">Should onCollision be called? If not, triggerCollisionEvents needs to be called later</param>
+	static void resolveContact(const Contact& contact, bool triggerEvents = true);
+	// Move the objects in a contact apart, without changing their velocities
+	static void separateContact(const Contact& contact);
+	// Call onCollision for the objects in the contact
+	static void triggerCollisionEvents(const Contact& contact);
+
+	/// <summary>
+	/// Find when an object moving in a straight line first touches another object. Only the part of the path where their boxes overlap is checked,
+	/// in steps no longer than the objects inner radius, so nothing can be skipped over. Then the first touching time is narrowed down
+	/// </summary>
+	/// <param name="start">Where the object moves from. Its current position is where it moves to</param>
+	/// <param name="timeOut">Set to the fraction of the path travelled when they first touch</param>
+	/// <returns>False if they never touch, or are already touching at the start. Collision filters are ignored</returns>
+	static bool findTimeOfImpact(StaticObject* object, const raylib::Vector3& start, const StaticObject* other, float& timeOut);
+	/// <summary>
+	/// Move an object back along its path to where it first touched one of the candidates, so the collision is found next physics step.
+	/// Only the position is swept, so the objects current rotation is used along the whole path
+	/// </summary>
+	/// <param name="start">Where the object moved from. Its current position is where it moved to</param>
+	/// <param name="candidates">Objects that might be in the way. The object itself is ignored if included</param>
+	/// <returns>True if the object was moved back</returns>
+	static bool sweepObject(GameObject* object, const raylib::Vector3& start, const std::vector<StaticObject*>& candidates);
+
 private:
-	static void applyContactForces(StaticObject* obj1, StaticObject* obj2, raylib::Vector3 collisionNorm, float pen);
-};
\ No newline at end of file
+	// Push the objects apart along the normal. A null object has 'infinite' mass, and wont be moved
+	static void applyContactForces(GameObject* gameObj1, GameObject* gameObj2, raylib::Vector3 collisionNorm, float pen);
+};
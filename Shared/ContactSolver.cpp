@@ -0,0 +1,378 @@
+#include "ContactSolver.h"
+#include "SlotMap.h"
+#include <algorithm>
+
+
+unsigned long long ContactSolver::getSortKey(const Contact& contact)
+{
+	// Static objects dont have an ID, so use their index with the bit slot maps never set in an ID, to keep them seperate
+	unsigned int key2 = contact.object2->isStatic() ? 
+		(SlotMap::reservedBit | (unsigned int)contact.object2->getStaticIndex()) : 
+		static_cast<GameObject*>(contact.object2)->getID();
+
+	return ((unsigned long long)contact.object1->getID() << 32) | key2;
+}
+
+
+void ContactSolver::solve(std::vector<Contact>& contacts, JobSystem& jobSystem, int iterations)
+{
+	solveCount++;
+	if (contacts.empty())
+	{
+		manifoldCache.clear();
+		return;
+	}
+
+	// Sort contacts so the islands and the order they are resolved in dont depend on the order contacts were found in
+	std::sort(contacts.begin(), contacts.end(), [](const Contact& a, const Contact& b)
+	{
+		return getSortKey(a) < getSortKey(b);
+	});
+
+
+	// Wake sleeping objects that were hit by a moving object. Objects that stay asleep are treated as static
+	for (unsigned int i = 0; i < contacts.size(); i++)
+	{
+		if (contacts[i].object2->isStatic() || contacts[i].object1->isResting())
+		{
+			continue;
+		}
+
+		GameObject* object2 = static_cast<GameObject*>(contacts[i].object2);
+		if (!object2->isAwake())
+		{
+			object2->wake();
+		}
+	}
+
+	// Group bodies into islands. Static and sleeping objects are never changed, so they dont join islands together
+	for (unsigned int i = 0; i < contacts.size(); i++)
+	{
+		int index1 = getBodyIndex(contacts[i].object1);
+		// Awake game objects are always added, even when they wont be affected, so no two islands read and write the same object
+		if (!contacts[i].object2->isStatic() && static_cast<GameObject*>(contacts[i].object2)->isAwake())
+		{
+			merge(index1, getBodyIndex(static_cast<GameObject*>(contacts[i].object2)));
+		}
+	}
+
+	// Number islands in the order they are first seen, and count their contacts
+	rootToIsland.assign(bodies.size(), -1);
+	contactIslands.resize(contacts.size());
+	islandStarts.clear();
+	for (unsigned int i = 0; i < contacts.size(); i++)
+	{
+		int root = findRoot(contacts[i].object1->islandIndex);
+		if (rootToIsland[root] == -1)
+		{
+			rootToIsland[root] = (int)islandStarts.size();
+			islandStarts.push_back(0);
+		}
+
+		contactIslands[i] = rootToIsland[root];
+		islandStarts[contactIslands[i]]++;
+	}
+
+	// Turn the counts into start indices, then place each contact in its island, keeping their sorted order
+	int total = 0;
+	for (unsigned int i = 0; i < islandStarts.size(); i++)
+	{
+		int count = islandStarts[i];
+		islandStarts[i] = total;
+		total += count;
+	}
+	islandStarts.push_back(total);
+
+	sortedContacts.resize(contacts.size());
+	islandCursors.assign(islandStarts.begin(), islandStarts.end() - 1);
+	for (unsigned int i = 0; i < contacts.size(); i++)
+	{
+		sortedContacts[islandCursors[contactIslands[i]]++] = i;
+	}
+
+
+	// Find the impulses each pair had last step. The cache is only read while islands are being solved
+	constraints.resize(contacts.size());
+	cachedManifolds.resize(contacts.size());
+	for (unsigned int i = 0; i < contacts.size(); i++)
+	{
+		auto cached = manifoldCache.find(getSortKey(contacts[i]));
+		cachedManifolds[i] = cached != manifoldCache.end() ? &cached->second : nullptr;
+	}
+
+
+	// Islands dont share any game objects, so they can be resolved at the same time
+	size_t islandCount = islandStarts.size() - 1;
+	jobSystem.parallelFor(islandCount, [&](size_t island)
+	{
+		int start = islandStarts[island];
+		int end = islandStarts[island + 1];
+
+		// Velocities used for restitution need to be found before any impulses are applied
+		for (int i = start; i < end; i++)
+		{
+			prepareConstraint(contacts[sortedContacts[i]], cachedManifolds[sortedContacts[i]], constraints[sortedContacts[i]]);
+		}
+		for (int i = start; i < end; i++)
+		{
+			warmStart(constraints[sortedContacts[i]]);
+		}
+
+		// Each iteration brings every contact closer to the impulses that solve all of them together
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (int i = start; i < end; i++)
+			{
+				solveVelocities(constraints[sortedContacts[i]]);
+			}
+		}
+
+		for (int i = start; i < end; i++)
+		{
+			CollisionSystem::separateContact(contacts[sortedContacts[i]]);
+		}
+	});
+
+
+	// Keep the impulses for the next step, and forget pairs that have stopped touching
+	for (unsigned int i = 0; i < contacts.size(); i++)
+	{
+		const Constraint& constraint = constraints[i];
+		CachedManifold& manifold = manifoldCache[getSortKey(contacts[i])];
+		for (int j = 0; j < constraint.pointCount; j++)
+		{
+			manifold.localPoints[j] = constraint.points[j].localPoint;
+			manifold.normalImpulses[j] = constraint.points[j].normalImpulse;
+			manifold.tangentImpulses[j][0] = constraint.points[j].tangentImpulse[0];
+			manifold.tangentImpulses[j][1] = constraint.points[j].tangentImpulse[1];
+		}
+		manifold.pointCount = constraint.pointCount;
+		manifold.lastUsed = solveCount;
+	}
+	for (auto it = manifoldCache.begin(); it != manifoldCache.end();)
+	{
+		if (it->second.lastUsed != solveCount)
+		{
+			it = manifoldCache.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	// Events can change game state, so they are triggered on this thread in island order
+	for (unsigned int i = 0; i < sortedContacts.size(); i++)
+	{
+		CollisionSystem::triggerCollisionEvents(contacts[sortedContacts[i]]);
+	}
+
+
+	// Reset bodies for the next solve, remembering they were touching something
+	for (unsigned int i = 0; i < bodies.size(); i++)
+	{
+		bodies[i]->islandIndex = -1;
+		bodies[i]->lastContactSolve = solveCount;
+	}
+	bodies.clear();
+	parents.clear();
+}
+
+
+void ContactSolver::prepareConstraint(const Contact& contact, const CachedManifold* cached, Constraint& constraintOut)
+{
+	// Points that have moved less than this in object1's local space keep their impulses from last step
+	const float matchDistance = 0.05f;
+	// Objects approaching slower than this wont bounce, so resting objects stay still
+	const float restitutionThreshold = 0.5f;
+
+	Constraint& c = constraintOut;
+	c.object1 = contact.object1;
+	c.object2 = contact.object2->isStatic() ? nullptr : static_cast<GameObject*>(contact.object2);
+	c.shouldAffectObject2 = contact.shouldAffectObject2 && c.object2 && c.object2->isAwake();
+	c.normal = contact.normal;
+
+	// Any two directions perpendicular to the normal will do, as long as the same ones are found each step
+	if (fabsf(c.normal.x) >= 0.57735f)
+	{
+		c.tangents[0] = Vec3(c.normal.y, -c.normal.x, 0).normalized();
+	}
+	else
+	{
+		c.tangents[0] = Vec3(0, c.normal.z, -c.normal.y).normalized();
+	}
+	c.tangents[1] = c.normal.cross(c.tangents[0]);
+
+	float friction2 = c.object2 ? c.object2->getFriction() : 1;
+	c.friction = c.object1->getFriction() < friction2 ? c.object1->getFriction() : friction2;
+	float elasticity = 0.5f * (c.object1->getElasticity() + (c.object2 ? c.object2->getElasticity() : 0));
+
+
+	// Objects that wont be affected have 'infinite' mass
+	float inverseMass1 = c.object1->getInverseMass();
+	float inverseMass2 = c.shouldAffectObject2 ? c.object2->getInverseMass() : 0;
+	const Mat3& invInertia1 = c.object1->getWorldInverseInertia();
+	Mat3 invInertia2 = c.shouldAffectObject2 ? c.object2->getWorldInverseInertia() : Mat3();
+
+	Vec3 velocity2 = c.object2 ? Vec3(c.object2->getVelocity()) : Vec3();
+	Vec3 angularVelocity2 = c.object2 ? Vec3(c.object2->getAngularVelocity()) : Vec3();
+	// Transposing the rotation gives the inverse, which moves world space directions into object1's local space
+	Mat3 toLocal1 = c.object1->getTransform().rotation.transposed();
+
+	c.pointCount = contact.pointCount;
+	for (int i = 0; i < c.pointCount; i++)
+	{
+		ConstraintPoint& point = c.points[i];
+		point.radius1 = Vec3(contact.points[i]) - c.object1->getPosition();
+		point.radius2 = Vec3(contact.points[i]) - contact.object2->getPosition();
+		point.localPoint = toLocal1 * point.radius1;
+
+		// How much an impulse along a direction will change the relitive velocity at this point
+		auto getInverseMass = [&](const Vec3& direction)
+		{
+			float inverseMass = inverseMass1 + inverseMass2;
+			inverseMass += direction.dot((invInertia1 * point.radius1.cross(direction)).cross(point.radius1));
+			inverseMass += direction.dot((invInertia2 * point.radius2.cross(direction)).cross(point.radius2));
+			return inverseMass;
+		};
+		float normalInverseMass = getInverseMass(c.normal);
+		point.normalMass = normalInverseMass > 0 ? 1 / normalInverseMass : 0;
+		for (int j = 0; j < 2; j++)
+		{
+			float tangentInverseMass = getInverseMass(c.tangents[j]);
+			point.tangentMass[j] = tangentInverseMass > 0 ? 1 / tangentInverseMass : 0;
+		}
+
+		// Bounce back with a fraction of the speed the objects are approaching at
+		Vec3 pointVelocity1 = Vec3(c.object1->getVelocity()) + Vec3(c.object1->getAngularVelocity()).cross(point.radius1);
+		Vec3 pointVelocity2 = velocity2 + angularVelocity2.cross(point.radius2);
+		float normalVelocity = (pointVelocity2 - pointVelocity1).dot(c.normal);
+		point.velocityBias = normalVelocity < -restitutionThreshold ? -elasticity * normalVelocity : 0;
+
+		// Start from last step's impulses if this point was there last step
+		point.normalImpulse = 0;
+		point.tangentImpulse[0] = 0;
+		point.tangentImpulse[1] = 0;
+		if (cached)
+		{
+			for (int j = 0; j < cached->pointCount; j++)
+			{
+				if ((point.localPoint - cached->localPoints[j]).lengthSqr() < matchDistance * matchDistance)
+				{
+					point.normalImpulse = cached->normalImpulses[j];
+					point.tangentImpulse[0] = cached->tangentImpulses[j][0];
+					point.tangentImpulse[1] = cached->tangentImpulses[j][1];
+					break;
+				}
+			}
+		}
+	}
+}
+
+void ContactSolver::warmStart(Constraint& constraint)
+{
+	for (int i = 0; i < constraint.pointCount; i++)
+	{
+		const ConstraintPoint& point = constraint.points[i];
+		Vec3 impulse = constraint.normal * point.normalImpulse + constraint.tangents[0] * point.tangentImpulse[0] + constraint.tangents[1] * point.tangentImpulse[1];
+		applyImpulse(constraint, point, impulse);
+	}
+}
+
+void ContactSolver::solveVelocities(Constraint& constraint)
+{
+	GameObject* object1 = constraint.object1;
+	GameObject* object2 = constraint.object2;
+
+	for (int i = 0; i < constraint.pointCount; i++)
+	{
+		ConstraintPoint& point = constraint.points[i];
+
+		// The velocity of object2 relitive to object1 at the contact point
+		auto getRelitiveVelocity = [&]()
+		{
+			Vec3 pointVelocity1 = Vec3(object1->velocity()) + Vec3(object1->angularVelocity()).cross(point.radius1);
+			Vec3 pointVelocity2 = object2 ? Vec3(object2->velocity()) + Vec3(object2->angularVelocity()).cross(point.radius2) : Vec3();
+			return pointVelocity2 - pointVelocity1;
+		};
+
+
+		// Friction is solved first, as it is less important than stopping the objects going through eachother
+		float maxFriction = constraint.friction * point.normalImpulse;
+		for (int j = 0; j < 2; j++)
+		{
+			float tangentVelocity = getRelitiveVelocity().dot(constraint.tangents[j]);
+			float lambda = -point.tangentMass[j] * tangentVelocity;
+
+			// Clamp the total impulse to the friction cone, and only apply the change
+			float oldImpulse = point.tangentImpulse[j];
+			float newImpulse = oldImpulse + lambda;
+			point.tangentImpulse[j] = newImpulse > maxFriction ? maxFriction : (newImpulse < -maxFriction ? -maxFriction : newImpulse);
+			applyImpulse(constraint, point, constraint.tangents[j] * (point.tangentImpulse[j] - oldImpulse));
+		}
+
+		// Normal
+		float normalVelocity = getRelitiveVelocity().dot(constraint.normal);
+		float lambda = -point.normalMass * (normalVelocity - point.velocityBias);
+
+		// The total impulse can only push the objects apart
+		float oldImpulse = point.normalImpulse;
+		float newImpulse = oldImpulse + lambda;
+		point.normalImpulse = newImpulse > 0 ? newImpulse : 0;
+		applyImpulse(constraint, point, constraint.normal * (point.normalImpulse - oldImpulse));
+	}
+}
+
+void ContactSolver::applyImpulse(Constraint& constraint, const ConstraintPoint& point, const Vec3& impulse)
+{
+	GameObject* object1 = constraint.object1;
+	object1->velocity() = (Vec3(object1->velocity()) - impulse * object1->getInverseMass()).toRaylib();
+	object1->angularVelocity() = (Vec3(object1->angularVelocity()) - object1->getWorldInverseInertia() * point.radius1.cross(impulse)).toRaylib();
+
+	if (constraint.shouldAffectObject2)
+	{
+		GameObject* object2 = constraint.object2;
+		object2->velocity() = (Vec3(object2->velocity()) + impulse * object2->getInverseMass()).toRaylib();
+		object2->angularVelocity() = (Vec3(object2->angularVelocity()) + object2->getWorldInverseInertia() * point.radius2.cross(impulse)).toRaylib();
+	}
+}
+
+
+int ContactSolver::getBodyIndex(GameObject* object)
+{
+	if (object->islandIndex == -1)
+	{
+		object->islandIndex = (int)bodies.size();
+		bodies.push_back(object);
+		parents.push_back(object->islandIndex);
+	}
+
+	return object->islandIndex;
+}
+
+int ContactSolver::findRoot(int index)
+{
+	while (parents[index] != index)
+	{
+		// Path halving keeps the trees flat
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+	return index;
+}
+
+void ContactSolver::merge(int index1, int index2)
+{
+	int root1 = findRoot(index1);
+	int root2 = findRoot(index2);
+
+	// Use the lowest index as the root, so islands are numbered the same way every time
+	if (root1 < root2)
+	{
+		parents[root2] = root1;
+	}
+	else if (root2 < root1)
+	{
+		parents[root1] = root2;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "CollisionSystem.h"
+#include "JobSystem.h"
+#include <vector>
+#include <unordered_map>
+
+
+/// <summary>
+/// Resolves contacts by grouping them into islands of objects that are touching. Islands can not affect each other, 
+/// so they are resolved in parallel, with collision events triggered afterwards in a deterministic order.
+/// Each island is solved with sequential impulses, starting from the impulses found for the same pair last physics step
+/// </summary>
+class ContactSolver
+{
+public:
+	/// <summary>
+	/// Resolve every contact. Contacts will be reordered so the result does not depend on the order they were found in
+	/// </summary>
+	/// <param name="jobSystem">Used to resolve islands in parallel</param>
+	/// <param name="iterations">How many times the impulses of every contact are solved. More iterations let stacks settle faster</param>
+	void solve(std::vector<Contact>& contacts, JobSystem& jobSystem, int iterations = 8);
+	// Forget the impulses kept from previous physics steps
+	void clearCache() { manifoldCache.clear(); }
+	// The number of solves so far. Objects with a contact in the last solve have it as their lastContactSolve
+	unsigned int getSolveCount() const { return solveCount; }
+
+	// Returns a key used to sort contacts, made from the IDs of both objects
+	static unsigned long long getSortKey(const Contact& contact);
+
+private:
+	// A contact point being solved
+	struct ConstraintPoint
+	{
+		// The contact point relitive to each object, and relitive to object1 in its local space
+		Vec3 radius1;
+		Vec3 radius2;
+		Vec3 localPoint;
+
+		// The inverse of how much each impulse changes the velocity at the point
+		float normalMass;
+		float tangentMass[2];
+		// The seperating velocity the objects should have along the normal, from elasticity
+		float velocityBias;
+
+		// Impulses accumulated over every iteration
+		float normalImpulse;
+		float tangentImpulse[2];
+	};
+	// A contact being solved, with everything that doesnt change between iterations
+	struct Constraint
+	{
+		GameObject* object1;
+		// Null if the other object is static
+		GameObject* object2;
+		// Static, sleeping, and unaffected objects keep their velocity, as if they had infinite mass
+		bool shouldAffectObject2;
+
+		Vec3 normal;
+		Vec3 tangents[2];
+		float friction;
+
+		ConstraintPoint points[Contact::maxPoints];
+		int pointCount;
+	};
+	// Impulses from a previous physics step, with points in object1's local space so they can be matched to new ones
+	struct CachedManifold
+	{
+		Vec3 localPoints[Contact::maxPoints];
+		float normalImpulses[Contact::maxPoints];
+		float tangentImpulses[Contact::maxPoints][2];
+		int pointCount = 0;
+
+		// The solve this manifold was last used in
+		unsigned int lastUsed = 0;
+	};
+
+	// Find the masses and velocity bias of each point, and match them to cached impulses
+	static void prepareConstraint(const Contact& contact, const CachedManifold* cached, Constraint& constraintOut);
+	// Apply the impulses kept from the last physics step
+	static void warmStart(Constraint& constraint);
+	// Solve friction and normal impulses for every point once
+	static void solveVelocities(Constraint& constraint);
+	// Apply an impulse to both objects at a point, pushing object2 along it and object1 against it
+	static void applyImpulse(Constraint& constraint, const ConstraintPoint& point, const Vec3& impulse);
+
+	// Get the index of a body, adding it if it hasnt been seen this solve
+	int getBodyIndex(GameObject* object);
+	// Find the root of the island containing a body
+	int findRoot(int index);
+	// Merge the islands containing two bodies
+	void merge(int index1, int index2);
+
+
+private:
+	// Every game object in a contact, and the parent used to find its island
+	std::vector<GameObject*> bodies;
+	std::vector<int> parents;
+
+	// The island number for each root body, in the order they were first seen
+	std::vector<int> rootToIsland;
+	// Index of the first contact of each island in sortedContacts, with an extra at the end
+	std::vector<int> islandStarts;
+	// Contact indices grouped by island
+	std::vector<int> sortedContacts;
+	// Where the next contact of each island goes while grouping
+	std::vector<int> islandCursors;
+	// The island each contact belongs to
+	std::vector<int> contactIslands;
+
+	// The constraint for each contact, and the manifold it was matched to from the last step
+	std::vector<Constraint> constraints;
+	std::vector<const CachedManifold*> cachedManifolds;
+
+	// Impulses from previous physics steps. <sort key, manifold>
+	std::unordered_map<unsigned long long, CachedManifold> manifoldCache;
+	// The number of solves so far, used to remove pairs that are no longer touching from the cache
+	unsigned int solveCount = 0;
+};
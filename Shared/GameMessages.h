@@ -9,6 +9,7 @@ enum GameMessages
 	ID_SERVER_CREATE_GAME_OBJECT,	// Used to instantiate a new game object
 	ID_SERVER_DESTROY_GAME_OBJECT,	// Used to destroy a game object
 	ID_SERVER_UPDATE_GAME_OBJECT,	// Used to update the rigidbody values of a game object
+	ID_SERVER_SNAPSHOT,		// Used to update the rigidbody values of many game objects at once, all with the same time stamp
 
 	ID_CLIENT_INPUT,		// Used to send player input to the server
 
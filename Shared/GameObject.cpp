@@ -4,39 +4,44 @@
 
 GameObject::GameObject() :
 	StaticObject(), objectID(-1), lastPacketTime(RakNet::GetTime()),
-	velocity(0, 0, 0), angularVelocity(0, 0, 0), mass(1), elasticity(1), linearDrag(0), angularDrag(0)
+	mass(1), elasticity(1), linearDrag(0), angularDrag(0), detachedVelocity(0, 0, 0), detachedAngularVelocity(0, 0, 0)
 {
 	// Game objects are not static
 	bIsStatic = false;
 	typeID = -1;
 
-	// Use the collider to get moment. If mass or the collider is ever changed, this should be recalculated
-	moment = (getCollider() ? getCollider()->calculateInertiaTensor(mass) : MatrixIdentity());
+	calculateMassProperties();
 }
 
 GameObject::GameObject(raylib::Vector3 position, raylib::Vector3 rotation, unsigned int objectID, float mass, float elasticity, Collider* collider, float linearDrag, float angularDrag, float friction, bool lockRotation) :
 	StaticObject(position, rotation, collider), objectID(objectID), lastPacketTime(RakNet::GetTime()),
-	velocity(0,0,0), angularVelocity(0,0,0), mass(mass), elasticity(elasticity), linearDrag(linearDrag), angularDrag(angularDrag), friction(friction), lockRotation(lockRotation)
+	mass(mass), elasticity(elasticity), linearDrag(linearDrag), angularDrag(angularDrag), friction(friction), detachedVelocity(0,0,0), detachedAngularVelocity(0,0,0)
 {
 	// Game objects are not static
 	bIsStatic = false;
 	typeID = -1;
+	if (lockRotation)
+	{
+		detachedFlags |= BodyStorage::LockRotation;
+	}
 
-	// Use the collider to get moment. If mass or the collider is ever changed, this should be recalculated
-	moment = (getCollider() ? getCollider()->calculateInertiaTensor(mass) : MatrixIdentity());
+	calculateMassProperties();
 }
 
 GameObject::GameObject(PhysicsState initState, unsigned int objectID, float mass, float elasticity, Collider* collider, float linearDrag, float angularDrag, float friction, bool lockRotation) :
 	StaticObject(initState.position, initState.rotation, collider), objectID(objectID), lastPacketTime(RakNet::GetTime()),
-	velocity(initState.velocity), angularVelocity(initState.angularVelocity), 
-	mass(mass), elasticity(elasticity), linearDrag(linearDrag), angularDrag(angularDrag), friction(friction), lockRotation(lockRotation)
+	mass(mass), elasticity(elasticity), linearDrag(linearDrag), angularDrag(angularDrag), friction(friction), 
+	detachedVelocity(initState.velocity), detachedAngularVelocity(initState.angularVelocity)
 {
 	// Game objects are not static
 	bIsStatic = false;
 	typeID = -1;
+	if (lockRotation)
+	{
+		detachedFlags |= BodyStorage::LockRotation;
+	}
 
-	// Use the collider to get moment. If mass or the collider is ever changed, this should be recalculated
-	moment = (getCollider() ? getCollider()->calculateInertiaTensor(mass) : MatrixIdentity());
+	calculateMassProperties();
 }
 
 
@@ -44,50 +49,160 @@ void GameObject::serialize(RakNet::BitStream& bs) const
 {
 	bs.Write(objectID);
 	
-	// [typeID, collider info, position, rotation]
+	// [typeID, collider info, position, rotation, collision category, collision mask]
 	StaticObject::serialize(bs);
 
 	// Moment is generated from collider, so doesnt need to be sent
-	bs.Write(velocity);
-	bs.Write(angularVelocity);
+	bs.Write(velocity());
+	bs.Write(angularVelocity());
 	bs.Write(mass);
 	bs.Write(elasticity);
 	bs.Write(friction);
+	bs.Write(isAwake());
+}
+
+
+void GameObject::calculateMassProperties()
+{
+	// Use the collider to get moment
+	moment = (getCollider() ? getCollider()->calculateInertiaTensor(mass) : Mat3::identity());
+
+	inverseMass() = 1 / mass;
+	localInverseInertia = moment.inverse();
+	hasWorldInverseInertia = false;
+}
+
+const Mat3& GameObject::getWorldInverseInertia() const
+{
+	// Only changes when the object rotates, so it is recalculated at most once per physics step
+	if (!hasWorldInverseInertia || inertiaRotation != rotation())
+	{
+		worldInverseInertia = localInverseInertia.rotated(getTransform().rotation);
+		inertiaRotation = rotation();
+		hasWorldInverseInertia = true;
+	}
+
+	return worldInverseInertia;
 }
 
 
 void GameObject::physicsStep(float timeStep)
 {
-	fixedUpdate(timeStep);
+	if (!prepareStep(timeStep))
+	{
+		return;
+	}
 
 	// Linear
-	position += velocity * timeStep;
-	velocity -= velocity * linearDrag * timeStep;
+	position() += velocity() * timeStep;
+	velocity() -= velocity() * linearDrag * timeStep;
 
 	// Angular
-	if (!lockRotation)
+	if (!isRotationLocked())
 	{
-		rotation += angularVelocity * timeStep;
-		angularVelocity -= angularVelocity * angularDrag * timeStep;
+		rotation() = rotation().integrated(angularVelocity(), timeStep);
+		angularVelocity() -= angularVelocity() * angularDrag * timeStep;
+	}
+}
+
+bool GameObject::prepareStep(float timeStep)
+{
+	if (!isAwake())
+	{
+		return false;
+	}
+
+	// Objects that have been resting for long enough fall asleep
+	if (canSleep && isResting())
+	{
+		sleepTimer += timeStep;
+		if (sleepTimer >= sleep_time)
+		{
+			sleep();
+			return false;
+		}
 	}
 	else
 	{
-		angularVelocity = Vector3Zero();
+		sleepTimer = 0;
 	}
+
+	fixedUpdate(timeStep);
+
+	if (isRotationLocked())
+	{
+		angularVelocity() = Vector3Zero();
+	}
+	return true;
+}
+
+
+raylib::Vector3 GameObject::integrateRotation(const raylib::Vector3& rotation, const raylib::Vector3& angularVelocity, float time)
+{
+	if (Vector3LengthSqr(angularVelocity) * time == 0)
+	{
+		return rotation;
+	}
+
+	return Quat::fromEuler(rotation).integrated(angularVelocity, time).toEuler();
+}
+
+void GameObject::addEulerRotation(const raylib::Vector3& angles)
+{
+	// Converting to and from euler angles isnt exact, so dont change the rotation if nothing is added
+	if (angles.x != 0 || angles.y != 0 || angles.z != 0)
+	{
+		rotation() = Quat::fromEuler(Vector3Add(rotation().toEuler(), angles));
+	}
+}
+
+
+void GameObject::wake()
+{
+	flags() |= BodyStorage::Awake;
+	sleepTimer = 0;
+}
+
+void GameObject::sleep()
+{
+	flags() &= ~BodyStorage::Awake;
+	sleepTimer = 0;
+	velocity() = Vector3Zero();
+	angularVelocity() = Vector3Zero();
+}
+
+bool GameObject::sleepIfResting()
+{
+	// A single slow step isnt enough, since objects are also slow at the top of a jump
+	if (!isAwake() || !canSleep || !isResting() || sleepTimer <= 0)
+	{
+		return false;
+	}
+
+	sleep();
+	return true;
+}
+
+bool GameObject::isResting() const
+{
+	return Vector3LengthSqr(velocity()) < sleep_velocityThreshold * sleep_velocityThreshold &&
+		   Vector3LengthSqr(angularVelocity()) < sleep_angularThreshold * sleep_angularThreshold;
 }
 
 
 void GameObject::applyForce(const raylib::Vector3& force, const raylib::Vector3& relitivePosition)
 {
-	velocity += Vector3Scale(force, 1 / getMass());
+	wake();
+	applyImpulse(force, relitivePosition);
+}
 
-	// Torque is multiplied by intertia tensor, then converted to local space
-	// This does not work as intended, probably due to rotation being used inconsistently
-	raylib::Vector3 torque = Vector3CrossProduct(relitivePosition, force);
-	torque = torque.Transform(getMoment().Invert());
-	torque = torque.Transform(MatrixTranspose(MatrixRotateXYZ(rotation)));
+void GameObject::applyImpulse(const raylib::Vector3& force, const raylib::Vector3& relitivePosition)
+{
+	velocity() += Vector3Scale(force, inverseMass());
 
-	angularVelocity -= torque;
+	// Torque is multiplied by the world space inverse intertia tensor
+	Vec3 torque = Vec3(relitivePosition).cross(force);
+	angularVelocity() += (getWorldInverseInertia() * torque).toRaylib();
 }
 
 void GameObject::resolveCollision(StaticObject* otherObject, const raylib::Vector3& contact, const raylib::Vector3& collisionNormal, bool shouldAffectOther)
@@ -98,79 +213,87 @@ void GameObject::resolveCollision(StaticObject* otherObject, const raylib::Vecto
 	}
 
 	raylib::Vector3 normal = Vector3Normalize(collisionNormal);
+	applyCollisionImpulse(otherObject, contact, normal, shouldAffectOther);
+
+	// Trigger collision events
+	onCollision(otherObject, contact, normal);
+	if (!otherObject->isStatic() && shouldAffectOther)
+	{
+		static_cast<GameObject*>(otherObject)->onCollision(this, contact, -normal);
+	}
+}
+
+void GameObject::applyCollisionImpulse(StaticObject* otherObject, const raylib::Vector3& contact, const raylib::Vector3& collisionNormal, bool shouldAffectOther)
+{
+	Vec3 normal = collisionNormal;
 
 	// If the other object is not static, cast it to a game object
 	GameObject* otherGameObj = otherObject->isStatic() ? nullptr : static_cast<GameObject*>(otherObject);
 
 
 	// The collision point from the center of mass
-	raylib::Vector3 radius1 = Vector3Subtract(contact, getPosition());
-	raylib::Vector3 radius2 = Vector3Subtract(contact, otherObject->getPosition());
+	Vec3 radius1 = Vec3(contact) - getPosition();
+	Vec3 radius2 = Vec3(contact) - otherObject->getPosition();
 
 	// Find the velocities of the contact points
-	raylib::Vector3 pointVel1 = getVelocity() + getAngularVelocity().CrossProduct(radius1);
-	raylib::Vector3 pointVel2 = (otherGameObj ? otherGameObj->getVelocity() : raylib::Vector3(0)) + 
-					(otherGameObj ? otherGameObj->getAngularVelocity() : raylib::Vector3(0)).CrossProduct(radius2);
+	Vec3 pointVel1 = Vec3(velocity()) + Vec3(angularVelocity()).cross(radius1);
+	Vec3 pointVel2 = otherGameObj ? Vec3(otherGameObj->velocity()) + Vec3(otherGameObj->angularVelocity()).cross(radius2) : Vec3();
 
-	raylib::Vector3 relitiveVelocity = pointVel1 - pointVel2;
+	Vec3 relitiveVelocity = pointVel1 - pointVel2;
 
-	if (relitiveVelocity.DotProduct(normal) > 0) // They are moving closer
+	if (relitiveVelocity.dot(normal) > 0) // They are moving closer
 	{
+		// Sleeping objects are treated like static objects, so they have infinite mass the same as in ContactSolver
+		bool isOtherMovable = otherGameObj && otherGameObj->isAwake();
 		// Combined inverse mass of the objects
-		float inverseMass = 1 / getMass() + (otherGameObj ? 1 / otherGameObj->getMass() : 0);
-		raylib::Matrix invMoment1 = getMoment().Invert();
-		raylib::Matrix invMoment2 = (otherGameObj ? otherGameObj->getMoment().Invert() : raylib::Matrix());
+		float combinedInverseMass = inverseMass() + (isOtherMovable ? otherGameObj->inverseMass() : 0);
+		// Static objects cant rotate, so have an inverse inertia of 0
+		const Mat3& invInertia1 = getWorldInverseInertia();
+		Mat3 invInertia2 = (isOtherMovable ? otherGameObj->getWorldInverseInertia() : Mat3());
 
 
 		//	----------   Normal Impulse   ----------
 
 		// Restitution (elasticity) * magnitude of delta point velocity
-		float numerator = -(1 + 0.5f * (getElasticity() + (otherGameObj ? otherGameObj->getElasticity() : 0))) * relitiveVelocity.DotProduct(normal);
+		float numerator = -(1 + 0.5f * (getElasticity() + (otherGameObj ? otherGameObj->getElasticity() : 0))) * relitiveVelocity.dot(normal);
 		// Put simply, this is how much the collision point will resist linear velocity
-		float inverseMassSumNorm = inverseMass;
-		inverseMassSumNorm += normal.DotProduct(radius1.CrossProduct(normal).Transform(invMoment1).CrossProduct(radius1));
-		inverseMassSumNorm += normal.DotProduct(radius2.CrossProduct(normal).Transform(invMoment2).CrossProduct(radius2));
+		float inverseMassSumNorm = combinedInverseMass;
+		inverseMassSumNorm += normal.dot((invInertia1 * radius1.cross(normal)).cross(radius1));
+		inverseMassSumNorm += normal.dot((invInertia2 * radius2.cross(normal)).cross(radius2));
 
 		// Find and apply normal impulse
 		float j = (numerator / inverseMassSumNorm);
-		raylib::Vector3 normalImpulse = normal * j;
+		Vec3 normalImpulse = normal * j;
 
-		applyForce(normalImpulse, radius1);
-		if (otherGameObj && shouldAffectOther)
+		applyImpulse(normalImpulse.toRaylib(), radius1.toRaylib());
+		if (isOtherMovable && shouldAffectOther)
 		{
-			otherGameObj->applyForce(-normalImpulse, radius2);
+			otherGameObj->applyImpulse((-normalImpulse).toRaylib(), radius2.toRaylib());
 		}
 
 
 		//	----------   Friction Impulse   ----------
 
-		raylib::Vector3 tangent = Vector3Normalize(relitiveVelocity - normal * Vector3DotProduct(relitiveVelocity, normal));
+		Vec3 tangent = (relitiveVelocity - normal * relitiveVelocity.dot(normal)).normalized();
 		
-		float inverseMassSumTan = inverseMass;
-		inverseMassSumTan += tangent.DotProduct(radius1.CrossProduct(tangent).Transform(invMoment1).CrossProduct(radius1));
-		inverseMassSumTan += tangent.DotProduct(radius2.CrossProduct(tangent).Transform(invMoment2).CrossProduct(radius2));
+		float inverseMassSumTan = combinedInverseMass;
+		inverseMassSumTan += tangent.dot((invInertia1 * radius1.cross(tangent)).cross(radius1));
+		inverseMassSumTan += tangent.dot((invInertia2 * radius2.cross(tangent)).cross(radius2));
 		
 		float frictionCoef = min(getFriction(), otherGameObj ? otherGameObj->getFriction() : 1);
 
 		// Find and apply friction impulse
-		float jF = Vector3DotProduct(-relitiveVelocity, tangent) / inverseMassSumTan * frictionCoef;
-		raylib::Vector3 frictionImpulse = tangent * jF;
+		float jF = (-relitiveVelocity).dot(tangent) / inverseMassSumTan * frictionCoef;
+		Vec3 frictionImpulse = tangent * jF;
 		
-		velocity += Vector3Scale(frictionImpulse, 1 / getMass());
-		angularVelocity += Vector3Transform(Vector3CrossProduct(radius1, frictionImpulse), getMoment().Invert());
-		if (otherGameObj && shouldAffectOther)
+		velocity() += (frictionImpulse * inverseMass()).toRaylib();
+		angularVelocity() += (invInertia1 * radius1.cross(frictionImpulse)).toRaylib();
+		if (isOtherMovable && shouldAffectOther)
 		{
-			otherGameObj->velocity += Vector3Scale(-frictionImpulse, 1 / otherGameObj->getMass());
-			otherGameObj->angularVelocity += Vector3Transform(Vector3CrossProduct(radius2, -frictionImpulse), otherGameObj->getMoment().Invert());
+			otherGameObj->velocity() += (-frictionImpulse * otherGameObj->inverseMass()).toRaylib();
+			otherGameObj->angularVelocity() += (invInertia2 * radius2.cross(-frictionImpulse)).toRaylib();
 		}
 	}
-
-	// Trigger collision events
-	onCollision(otherObject, contact, normal);
-	if (otherGameObj && shouldAffectOther)
-	{
-		otherGameObj->onCollision(this, contact, -normal);
-	}
 }
 
 
@@ -187,34 +310,33 @@ void GameObject::updateState(const PhysicsState& state, RakNet::Time stateTime,
 	PhysicsState newState(state);
 	// Extrapolate to get the state at the current time using dead reckoning
 	newState.position += newState.velocity * deltaTime;
-	newState.rotation += newState.angularVelocity * deltaTime;
 
 
 	// These values are less noticible when snapped, and can be set directly
-	rotation = newState.rotation;
-	velocity = newState.velocity;
-	angularVelocity = newState.angularVelocity;
+	rotation() = Quat::fromEuler(newState.rotation).integrated(newState.angularVelocity, deltaTime);
+	velocity() = newState.velocity;
+	angularVelocity() = newState.angularVelocity;
 
 	// Should the position be updated with smoothing?
 	if (useSmoothing)
 	{
-		float dist = Vector3Distance(newState.position, position);
+		float dist = Vector3Distance(newState.position, position());
 
 		if (dist > smooth_snapDistance)
 		{
 			// We are too far away from the servers position: snap to it
-			position = newState.position;
+			position() = newState.position;
 		}
 		else if (dist > smooth_threshold) // If we are only a small distance from the real value, we dont move
 		{
 			// Move some of the way to the servers position
-			position += (newState.position - position) * smooth_moveFraction;
+			position() += (newState.position - position()) * smooth_moveFraction;
 		}
 	}
 	else
 	{
 		// Dont smooth: set directly
-		position = newState.position;
+		position() = newState.position;
 	}
 
 	
@@ -232,37 +354,37 @@ void GameObject::applyStateDiff(const PhysicsState& diffState, RakNet::Time stat
 
 
 	// Add the diff to the current state
-	raylib::Vector3 newPos = position + diffState.position;
-	rotation += diffState.rotation;
-	velocity += diffState.velocity;
-	angularVelocity += diffState.angularVelocity;
+	raylib::Vector3 newPos = position() + diffState.position;
+	addEulerRotation(diffState.rotation);
+	velocity() += diffState.velocity;
+	angularVelocity() += diffState.angularVelocity;
 	
 	// Extrapolate to get the state at the current time using dead reckoning
 	float deltaTime = (currentTime - stateTime) * 0.001f;
-	newPos += velocity * deltaTime;
-	rotation += angularVelocity * deltaTime;
+	newPos += velocity() * deltaTime;
+	rotation() = rotation().integrated(angularVelocity(), deltaTime);
 
 
 	// Should the position be updated with smoothing?
 	if (useSmoothing)
 	{
-		float dist = Vector3Distance(newPos, position);
+		float dist = Vector3Distance(newPos, position());
 
 		if (dist > smooth_snapDistance)
 		{
 			// We are too far away from the new position: snap to it
-			position = newPos;
+			position() = newPos;
 		}
 		else if (dist > smooth_threshold) // If we are only a small distance from the new value, we dont move
 		{
 			// Move some of the way to the new position
-			position += (newPos - position) * smooth_moveFraction;
+			position() += (newPos - position()) * smooth_moveFraction;
 		}
 	}
 	else
 	{
 		// Dont smooth: set directly
-		position = newPos;
+		position() = newPos;
 	}
 
 
@@ -1,6 +1,10 @@
 #pragma once
 #include "StaticObject.h"
 
+// Forward declarations
+class ContactSolver;
+class TransformHistory;
+
 
 /// <summary>
 /// Contains the variables that can be used to change a game objects physics state
@@ -27,6 +31,14 @@ struct PhysicsState
 /// </summary>
 class GameObject : public StaticObject
 {
+	// Collisions can be resolved in stages, so the collision system needs access to impulses and events
+	friend CollisionSystem;
+	// The solver keeps track of which island an object is in
+	friend ContactSolver;
+	// Lag compensation records where objects were, and moves them back there for hit tests
+	friend TransformHistory;
+	// Hot physics state is moved in and out of body storages
+	friend BodyStorage;
 public:
 	GameObject();
 	GameObject(raylib::Vector3 position, raylib::Vector3 rotation, unsigned int objectID, float mass, float elasticity, Collider* collider = nullptr, float linearDrag = 0, float angularDrag = 0, float friction = 1, bool lockRotation = false);
@@ -40,7 +52,7 @@ public:
 	void physicsStep(float timeStep);
 
 	/// <summary>
-	/// Apply a force at a point on the object
+	/// Apply a force at a point on the object, waking it if it is asleep
 	/// </summary>
 	/// <param name="relitivePosition">Where, in local space, the force should be applied. 
 	///								   If set to 0,0,0 then only linear velocity will be affected</param>
@@ -74,23 +86,52 @@ public:
 	void applyStateDiff(const PhysicsState& diffState, RakNet::Time stateTime, RakNet::Time currentTime, bool useSmoothing = false, bool shouldUpdateObjectTime = false);
 
 
+	/// <summary>
+	/// Rotate euler angles by an angular velocity over a period of time. Used for states sent over the network, 
+	/// physics steps rotate the orientation directly with Quat::integrated
+	/// </summary>
+	/// <param name="rotation">The rotation in euler angles, as used by MatrixRotateXYZ</param>
+	/// <param name="angularVelocity">The angular velocity in world space, in radians per second</param>
+	/// <returns>The new rotation in euler angles</returns>
+	static raylib::Vector3 integrateRotation(const raylib::Vector3& rotation, const raylib::Vector3& angularVelocity, float time);
+
+	// Wake the object, so it is moved by physics steps and collides with other objects again
+	void wake();
+	// Put the object to sleep, stopping it until it is woken
+	void sleep();
+	// Put the object to sleep straight away if it has been resting since the last physics step and is allowed to fall asleep. Returns true if it fell asleep
+	bool sleepIfResting();
+	// Is the object awake? Sleeping objects are not moved by physics steps, and only collide with awake objects
+	bool isAwake() const { return (flags() & BodyStorage::Awake) != 0; }
+	// Is the object moving slowly enough that it could fall asleep?
+	bool isResting() const;
+	// The ContactSolver solve the object last touched something in, or 0 if it never has
+	unsigned int getLastContactSolve() const { return lastContactSolve; }
+	// Should the server sweep this object along its path each physics step, so it cant pass through thin objects?
+	bool usesContinuousCollision() const { return useContinuousCollision; }
+
+
 	unsigned int getID() const { return objectID; }
 	// Returns the timestamp of the last update packet applied
 	RakNet::Time getTime() const { return lastPacketTime; }
 
 	// Returns the current PhysicsState of the object
-	PhysicsState getCurrentState() const { return { position, rotation, velocity, angularVelocity }; }
+	PhysicsState getCurrentState() const { return { position(), getRotation(), velocity(), angularVelocity() }; }
 
-	raylib::Vector3 getVelocity() const { return velocity; }
-	raylib::Vector3 getAngularVelocity() const { return angularVelocity; }
+	raylib::Vector3 getVelocity() const { return velocity(); }
+	raylib::Vector3 getAngularVelocity() const { return angularVelocity(); }
 
 	float getMass() const { return mass; }
-	raylib::Matrix getMoment() const { return moment; }
+	float getInverseMass() const { return inverseMass(); }
+	const Mat3& getMoment() const { return moment; }
+	// Get the inverse inertia tensor in world space. Recalculated when the object has rotated since it was last used
+	const Mat3& getWorldInverseInertia() const;
 	float getElasticity() const { return elasticity; }
 
 	float getlinearDrag() const { return linearDrag; }
 	float getAngularDrag() const { return angularDrag; }
 	float getFriction() const { return friction; }
+	bool isRotationLocked() const { return (flags() & BodyStorage::LockRotation) != 0; }
 
 
 protected:
@@ -102,10 +143,27 @@ protected:
 	virtual void onCollision(StaticObject* other, raylib::Vector3 contact, raylib::Vector3 normal) {}
 
 	/// <summary>
-	/// Called at the start of every physicsStep. Should not rely on external game state, as physicsStep is used in prediction
+	/// Called at the start of every physicsStep while the object is awake. Should not rely on external game state, as physicsStep is used in prediction
 	/// </summary>
 	virtual void fixedUpdate(float timeStep) {};
 
+	// Calculate moment, inverse mass, and inverse inertia from mass and the collider. If either is changed, this needs to be called again
+	void calculateMassProperties();
+
+	// Apply a force at a point on the object without waking it. Used by collisions, so resting contacts dont keep objects awake
+	void applyImpulse(const raylib::Vector3& force, const raylib::Vector3& relitivePosition);
+	// Apply normal and friction impulses for a collision, without triggering collision events. The normal needs to be normalized
+	void applyCollisionImpulse(StaticObject* otherObject, const raylib::Vector3& contact, const raylib::Vector3& collisionNormal, bool shouldAffectOther);
+
+	// Add euler angles to the objects rotation, as states sent over the network do
+	void addEulerRotation(const raylib::Vector3& angles);
+
+	// The objects velocity and angular velocity. Kept in the objects body storage while it is in one, so always use these
+	raylib::Vector3& velocity() { return bodies ? bodies->velocities[bodyIndex] : detachedVelocity; }
+	const raylib::Vector3& velocity() const { return bodies ? bodies->velocities[bodyIndex] : detachedVelocity; }
+	raylib::Vector3& angularVelocity() { return bodies ? bodies->angularVelocities[bodyIndex] : detachedAngularVelocity; }
+	const raylib::Vector3& angularVelocity() const { return bodies ? bodies->angularVelocities[bodyIndex] : detachedAngularVelocity; }
+
 
 
 protected:
@@ -116,6 +174,17 @@ protected:
 	// How much to move toward the servers position when using smoothing
 	const float smooth_moveFraction = 0.1f;
 
+	// How slow the object needs to be moving to fall asleep
+	const float sleep_velocityThreshold = 0.15f;
+	const float sleep_angularThreshold = 0.15f;
+	// How long, in seconds, the object needs to be resting before it falls asleep
+	const float sleep_time = 0.5f;
+	// Can the object fall asleep by itself? Client objects are controlled by input, so never do
+	bool canSleep = true;
+
+	// Should the server use continuous collision detection for this object? Use for small, fast objects such as projectiles
+	bool useContinuousCollision = false;
+
 	// A unique identifier for this object, nessesary for sending updates over the network
 	const unsigned int objectID;
 
@@ -123,17 +192,47 @@ protected:
 	// Time in milliseconds. Multiply by 0.001 for seconds
 	RakNet::Time lastPacketTime;
 
-	
-	raylib::Vector3 velocity;
-	raylib::Vector3 angularVelocity;
 
 	float mass;
-	raylib::Matrix moment;
+	Mat3 moment;
 	float elasticity;
 
+	// Cached from mass and moment by calculateMassProperties. Inverse mass is kept with the rest of the hot state
+	Mat3 localInverseInertia;
+
 	float linearDrag;
 	float angularDrag;
 	float friction;
 
-	bool lockRotation;
+private:
+	// Inverse mass, and BodyStorage::Flags such as whether the object is awake
+	float& inverseMass() { return bodies ? bodies->inverseMasses[bodyIndex] : detachedInverseMass; }
+	float inverseMass() const { return bodies ? bodies->inverseMasses[bodyIndex] : detachedInverseMass; }
+	unsigned char& flags() { return bodies ? bodies->flags[bodyIndex] : detachedFlags; }
+	unsigned char flags() const { return bodies ? bodies->flags[bodyIndex] : detachedFlags; }
+
+	// The part of a physics step that cant be batched: sleeping and fixedUpdate. Returns false if the object should not be moved
+	bool prepareStep(float timeStep);
+
+
+	// Used by ContactSolver while building islands. -1 when not in use
+	int islandIndex = -1;
+	// Set by ContactSolver for objects with a contact
+	unsigned int lastContactSolve = 0;
+	// The objects slot in the servers transform history, or -1 if it has not been recorded
+	int historySlot = -1;
+
+	// The hot state used while the object is not in a body storage
+	raylib::Vector3 detachedVelocity;
+	raylib::Vector3 detachedAngularVelocity;
+	float detachedInverseMass = 1;
+	unsigned char detachedFlags = BodyStorage::Awake;
+
+	// How long the object has been resting for
+	float sleepTimer = 0;
+
+	// The world space inverse inertia, and the rotation it was calculated with
+	mutable Mat3 worldInverseInertia;
+	mutable Quat inertiaRotation;
+	mutable bool hasWorldInverseInertia = false;
 };
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "IntegrationKernels.h"
+
+// SIMD kernels are only built for x86, other platforms use the scalar kernel
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define INTEGRATION_USE_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC allows AVX2 intrinsics anywhere, but GCC and Clang need functions using them to be marked
+#if defined(__GNUC__)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+
+void IntegrationKernels::integrate(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count)
+{
+	getKernel()(positions, velocities, angularVelocities, stepTimes, linearDrags, angularDrags, count);
+}
+
+const char* IntegrationKernels::getKernelName()
+{
+	Kernel kernel = getKernel();
+	if (kernel == integrateAVX2)
+	{
+		return "AVX2";
+	}
+	if (kernel == integrateSSE2)
+	{
+		return "SSE2";
+	}
+	return "Scalar";
+}
+
+
+void IntegrationKernels::integrateScalar(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		float stepTime = stepTimes[i];
+		for (size_t j = i * 3; j < i * 3 + 3; j++)
+		{
+			// Same order as GameObject::physicsStep, so results match exactly
+			float velocity = velocities[j];
+			positions[j] = positions[j] + velocity * stepTime;
+			velocities[j] = velocity - velocity * linearDrags[i] * stepTime;
+			angularVelocities[j] = angularVelocities[j] - angularVelocities[j] * angularDrags[i] * stepTime;
+		}
+	}
+}
+
+
+#ifdef INTEGRATION_USE_SIMD
+
+void IntegrationKernels::integrateSSE2(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count)
+{
+	// 4 bodies fill 3 registers of x, y, z floats, so each per body value is spread across 3 registers to line up with them
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 stepTime = _mm_loadu_ps(stepTimes + i);
+		__m128 linearDrag = _mm_loadu_ps(linearDrags + i);
+		__m128 angularDrag = _mm_loadu_ps(angularDrags + i);
+
+		// [0 0 0 1] [1 1 2 2] [2 3 3 3]
+		__m128 stepTime3[3] = { _mm_shuffle_ps(stepTime, stepTime, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(stepTime, stepTime, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(stepTime, stepTime, _MM_SHUFFLE(3, 3, 3, 2)) };
+		__m128 linearDrag3[3] = { _mm_shuffle_ps(linearDrag, linearDrag, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(linearDrag, linearDrag, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(linearDrag, linearDrag, _MM_SHUFFLE(3, 3, 3, 2)) };
+		__m128 angularDrag3[3] = { _mm_shuffle_ps(angularDrag, angularDrag, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_ps(angularDrag, angularDrag, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(angularDrag, angularDrag, _MM_SHUFFLE(3, 3, 3, 2)) };
+
+		for (int k = 0; k < 3; k++)
+		{
+			size_t offset = i * 3 + k * 4;
+			__m128 position = _mm_loadu_ps(positions + offset);
+			__m128 velocity = _mm_loadu_ps(velocities + offset);
+			__m128 angularVelocity = _mm_loadu_ps(angularVelocities + offset);
+
+			position = _mm_add_ps(position, _mm_mul_ps(velocity, stepTime3[k]));
+			velocity = _mm_sub_ps(velocity, _mm_mul_ps(_mm_mul_ps(velocity, linearDrag3[k]), stepTime3[k]));
+			angularVelocity = _mm_sub_ps(angularVelocity, _mm_mul_ps(_mm_mul_ps(angularVelocity, angularDrag3[k]), stepTime3[k]));
+
+			_mm_storeu_ps(positions + offset, position);
+			_mm_storeu_ps(velocities + offset, velocity);
+			_mm_storeu_ps(angularVelocities + offset, angularVelocity);
+		}
+	}
+
+	// Finish any bodies left over
+	integrateScalar(positions + i * 3, velocities + i * 3, angularVelocities + i * 3, stepTimes + i, linearDrags + i, angularDrags + i, count - i);
+}
+
+AVX2_FUNCTION void IntegrationKernels::integrateAVX2(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count)
+{
+	// 8 bodies fill 3 registers. [0 0 0 1 1 1 2 2] [2 3 3 3 4 4 4 5] [5 5 6 6 6 7 7 7]
+	const __m256i spread[3] =
+	{
+		_mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+		_mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+		_mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7)
+	};
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 stepTime = _mm256_loadu_ps(stepTimes + i);
+		__m256 linearDrag = _mm256_loadu_ps(linearDrags + i);
+		__m256 angularDrag = _mm256_loadu_ps(angularDrags + i);
+
+		for (int k = 0; k < 3; k++)
+		{
+			__m256 stepTime3 = _mm256_permutevar8x32_ps(stepTime, spread[k]);
+			__m256 linearDrag3 = _mm256_permutevar8x32_ps(linearDrag, spread[k]);
+			__m256 angularDrag3 = _mm256_permutevar8x32_ps(angularDrag, spread[k]);
+
+			size_t offset = i * 3 + k * 8;
+			__m256 position = _mm256_loadu_ps(positions + offset);
+			__m256 velocity = _mm256_loadu_ps(velocities + offset);
+			__m256 angularVelocity = _mm256_loadu_ps(angularVelocities + offset);
+
+			// Seperate multiplies and adds, not fused, to match the other kernels
+			position = _mm256_add_ps(position, _mm256_mul_ps(velocity, stepTime3));
+			velocity = _mm256_sub_ps(velocity, _mm256_mul_ps(_mm256_mul_ps(velocity, linearDrag3), stepTime3));
+			angularVelocity = _mm256_sub_ps(angularVelocity, _mm256_mul_ps(_mm256_mul_ps(angularVelocity, angularDrag3), stepTime3));
+
+			_mm256_storeu_ps(positions + offset, position);
+			_mm256_storeu_ps(velocities + offset, velocity);
+			_mm256_storeu_ps(angularVelocities + offset, angularVelocity);
+		}
+	}
+
+	// Avoid the penalty for mixing AVX and SSE instructions after returning
+	_mm256_zeroupper();
+
+	integrateScalar(positions + i * 3, velocities + i * 3, angularVelocities + i * 3, stepTimes + i, linearDrags + i, angularDrags + i, count - i);
+}
+
+
+// Does the CPU and OS support AVX2? The OS needs to save the upper half of the registers, which is checked with XGETBV
+static bool supportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+
+	__cpuid(info, 1);
+	bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+	if (!hasOSXSAVE || !hasAVX || (_xgetbv(0) & 6) != 6)
+	{
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool supportsSSE2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+IntegrationKernels::Kernel IntegrationKernels::getKernel()
+{
+	// Static locals are only initialised once, even with multiple threads
+	static const Kernel kernel = supportsAVX2() ? integrateAVX2 : (supportsSSE2() ? integrateSSE2 : integrateScalar);
+	return kernel;
+}
+
+#else
+
+// Without SIMD, the other kernels are the scalar one
+void IntegrationKernels::integrateSSE2(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count)
+{
+	integrateScalar(positions, velocities, angularVelocities, stepTimes, linearDrags, angularDrags, count);
+}
+
+void IntegrationKernels::integrateAVX2(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count)
+{
+	integrateScalar(positions, velocities, angularVelocities, stepTimes, linearDrags, angularDrags, count);
+}
+
+IntegrationKernels::Kernel IntegrationKernels::getKernel()
+{
+	return integrateScalar;
+}
+
+#endif
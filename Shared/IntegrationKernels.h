@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+
+
+/// <summary>
+/// Kernels used by BodyStorage to integrate many bodies at once, using the widest instructions the CPU supports (AVX2, SSE2, or plain floats).
+/// The kernel is chosen the first time one is used. Every kernel does the same floating point operations in the same order,
+/// so the result does not depend on which is used
+/// </summary>
+class IntegrationKernels
+{
+public:
+	/// <summary>
+	/// Move positions by velocities, then apply drag to velocities and angular velocities. Vectors are stored as x, y, z floats one after another,
+	/// and the other arrays have one value per body. Bodies with a step time of 0 are not changed
+	/// </summary>
+	/// <param name="count">The number of bodies</param>
+	static void integrate(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count);
+
+	// The name of the instructions being used, such as "AVX2"
+	static const char* getKernelName();
+
+private:
+	typedef void(*Kernel)(float*, float*, float*, const float*, const float*, const float*, size_t);
+
+	static void integrateScalar(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count);
+	static void integrateSSE2(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count);
+	static void integrateAVX2(float* positions, float* velocities, float* angularVelocities, const float* stepTimes, const float* linearDrags, const float* angularDrags, size_t count);
+
+	// Find the fastest kernel the CPU supports. Only done once
+	static Kernel getKernel();
+};
@@ -0,0 +1,82 @@
+#include "InterestGrid.h"
+#include "GameObject.h"
+#include <algorithm>
+#include <cmath>
+
+
+InterestGrid::InterestGrid(float cellSize) :
+	cellSize(cellSize)
+{
+}
+
+
+void InterestGrid::setCellSize(float cellSize)
+{
+	this->cellSize = cellSize;
+}
+
+void InterestGrid::clear()
+{
+	entries.clear();
+}
+
+void InterestGrid::add(GameObject* object)
+{
+	raylib::Vector3 position = object->getPosition();
+	entries.push_back({ getCellKey(getCellCoordinate(position.x), getCellCoordinate(position.z)), position.x, position.z, object });
+}
+
+void InterestGrid::build()
+{
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+	{
+		return a.cell < b.cell;
+	});
+}
+
+
+void InterestGrid::query(const raylib::Vector3& position, float radius, const std::function<void(GameObject*, float)>& callback) const
+{
+	int minX = getCellCoordinate(position.x - radius);
+	int maxX = getCellCoordinate(position.x + radius);
+	int minZ = getCellCoordinate(position.z - radius);
+	int maxZ = getCellCoordinate(position.z + radius);
+	float radiusSqr = radius * radius;
+
+	for (int z = minZ; z <= maxZ; z++)
+	{
+		// Every cell from minX to maxX in this row is one range of entries
+		unsigned long long lastCell = getCellKey(maxX, z);
+		auto it = std::lower_bound(entries.begin(), entries.end(), getCellKey(minX, z), [](const Entry& entry, unsigned long long cell)
+		{
+			return entry.cell < cell;
+		});
+
+		for (; it != entries.end() && it->cell <= lastCell; ++it)
+		{
+			float dx = it->x - position.x;
+			float dz = it->z - position.z;
+			float distanceSqr = dx * dx + dz * dz;
+			if (distanceSqr <= radiusSqr)
+			{
+				callback(it->object, distanceSqr);
+			}
+		}
+	}
+}
+
+
+int InterestGrid::getCellCoordinate(float value) const
+{
+	// Clamp far away positions, so they dont overflow. They share the edge cells, which only makes searches there slower
+	float cell = std::floor(value / cellSize);
+	if (!(cell > -1000000000.0f))
+	{
+		return -1000000000;
+	}
+	if (cell > 1000000000.0f)
+	{
+		return 1000000000;
+	}
+	return (int)cell;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "raylib-cpp.hpp"
+#include <vector>
+#include <functional>
+
+// Forward declarations
+class GameObject;
+
+
+/// <summary>
+/// A grid of square cells on the ground plane, used to find the objects near a point, ignoring height.
+/// Objects are sorted by cell, so each row of cells around a point is one contiguous range. Rebuilt whenever objects move, since that is cheaper than moving them between cells
+/// </summary>
+class InterestGrid
+{
+public:
+	InterestGrid(float cellSize = 32);
+
+
+	// Set the width of each cell. Searches are quickest when it is about the search radius. Only call while the grid is empty
+	void setCellSize(float cellSize);
+	float getCellSize() const { return cellSize; }
+
+	// Remove every object
+	void clear();
+	// Add an object at its current position. Call build once every object has been added
+	void add(GameObject* object);
+	// Sort the objects by cell, so they can be searched
+	void build();
+
+	/// <summary>
+	/// Call callback for every object within radius of position on the ground plane, with its squared distance
+	/// </summary>
+	void query(const raylib::Vector3& position, float radius, const std::function<void(GameObject*, float)>& callback) const;
+
+	size_t size() const { return entries.size(); }
+
+private:
+	struct Entry
+	{
+		unsigned long long cell;
+		float x;
+		float z;
+		GameObject* object;
+	};
+
+	int getCellCoordinate(float value) const;
+	// Rows are the high bits, so cells in the same row sort next to each other. Coordinates are offset, so negative cells sort before positive ones
+	static unsigned long long getCellKey(int x, int z) { return ((unsigned long long)((unsigned int)z ^ 0x80000000u) << 32) | ((unsigned int)x ^ 0x80000000u); }
+
+
+private:
+	float cellSize;
+	std::vector<Entry> entries;
+};
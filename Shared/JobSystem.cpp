@@ -0,0 +1,338 @@
+#include "JobSystem.h"
+
+
+namespace
+{
+	// The job system and queue used by this thread, if it is a worker or registered
+	thread_local const JobSystem* currentJobSystem = nullptr;
+	thread_local unsigned int currentQueueIndex = 0;
+}
+
+
+JobSystem::JobSystem(unsigned int workerCount) :
+	sharedQueueIndex(workerCount), queuedJobs(0)
+{
+	// Queues need to exist before any worker starts looking in them
+	for (unsigned int i = 0; i < workerCount + 1 + maxRegisteredThreads; i++)
+	{
+		queues.emplace_back(new JobQueue());
+	}
+
+	workers.reserve(workerCount);
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		isShuttingDown = true;
+	}
+	sleepCondition.notify_all();
+
+	for (auto& it : workers)
+	{
+		it.join();
+	}
+
+	// Jobs that were never waited on
+	for (auto& queue : queues)
+	{
+		for (Job* job : queue->jobs)
+		{
+			delete job;
+		}
+	}
+}
+
+
+unsigned int JobSystem::getDefaultWorkerCount()
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	return threads > 1 ? threads - 1 : 0;
+}
+
+
+void JobSystem::run(JobGroup& group, std::function<void()> func, JobGroup* dependency)
+{
+	Job* job = new Job{ std::move(func), &group };
+	group.pendingJobs.fetch_add(1, std::memory_order_relaxed);
+
+	// If the dependency hasnt finished, its last job will push this one
+	if (dependency)
+	{
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->pendingJobs.load(std::memory_order_acquire) != 0)
+		{
+			dependency->dependents.push_back(job);
+			return;
+		}
+	}
+
+	push(&job, 1, getQueueIndex());
+}
+
+void JobSystem::wait(JobGroup& group)
+{
+	// Threads that arent workers only help with the group they are waiting on, so a thread waiting on a little work
+	// doesnt get stuck running another threads. Without workers there is no one else to run jobs the group depends on
+	unsigned int queueIndex = getQueueIndex();
+	const JobGroup* onlyGroup = queueIndex < sharedQueueIndex || sharedQueueIndex == 0 ? nullptr : &group;
+	while (!group.isDone())
+	{
+		Job* job = findJob(queueIndex, onlyGroup);
+		if (job)
+		{
+			execute(job);
+		}
+		else
+		{
+			// The last jobs are running on other threads
+			std::this_thread::yield();
+		}
+	}
+
+	// The thread that ran the last job might still be using the group, so wait for it to let go before the group can be destroyed
+	std::lock_guard<std::mutex> lock(group.mutex);
+}
+
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t)>& func, size_t grainSize)
+{
+	parallelForRange(count, [&func](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			func(i);
+		}
+	}, grainSize);
+}
+
+void JobSystem::parallelForRange(size_t count, const std::function<void(size_t, size_t)>& func, size_t grainSize)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (grainSize == 0)
+	{
+		grainSize = 1;
+	}
+
+	// Without workers, or with only one range, there is nothing to gain from queueing jobs
+	if (workers.empty() || count <= grainSize)
+	{
+		func(0, count);
+		return;
+	}
+
+	// A few jobs for each thread is enough for stealing to balance the work. More would only add overhead
+	size_t maxJobs = (workers.size() + 1) * 4;
+	size_t rangeSize = (count + maxJobs - 1) / maxJobs;
+	if (rangeSize < grainSize)
+	{
+		rangeSize = grainSize;
+	}
+	size_t jobCount = (count + rangeSize - 1) / rangeSize;
+
+	JobGroup group;
+	group.pendingJobs.store(jobCount, std::memory_order_relaxed);
+	std::vector<Job*> jobs(jobCount);
+	for (size_t i = 0; i < jobCount; i++)
+	{
+		size_t begin = i * rangeSize;
+		size_t end = begin + rangeSize < count ? begin + rangeSize : count;
+		jobs[i] = new Job{ [&func, begin, end]() { func(begin, end); }, &group };
+	}
+
+	// Pushed in reverse, so the calling thread pops the first range first and workers steal from the end
+	std::vector<Job*> reversed(jobs.rbegin(), jobs.rend());
+	push(reversed.data(), reversed.size(), getQueueIndex());
+
+	// Help with the work, and wait for every range to finish so func is not used after it goes out of scope
+	wait(group);
+}
+
+
+void JobSystem::workerLoop(unsigned int queueIndex)
+{
+	currentJobSystem = this;
+	currentQueueIndex = queueIndex;
+
+	while (true)
+	{
+		Job* job = findJob(queueIndex);
+		if (job)
+		{
+			execute(job);
+			continue;
+		}
+
+		// Sleep until there is a job to take
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.wait(lock, [this]() { return isShuttingDown || queuedJobs.load() != 0; });
+		if (isShuttingDown)
+		{
+			return;
+		}
+	}
+}
+
+bool JobSystem::registerThread()
+{
+	if (currentJobSystem == this)
+	{
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(registerMutex);
+	for (unsigned int i = 0; i < maxRegisteredThreads; i++)
+	{
+		if (!isQueueRegistered[i])
+		{
+			isQueueRegistered[i] = true;
+			currentJobSystem = this;
+			currentQueueIndex = getSharedQueueIndex() + 1 + i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::unregisterThread()
+{
+	// Workers keep their queues
+	if (currentJobSystem != this || currentQueueIndex <= getSharedQueueIndex())
+	{
+		return;
+	}
+
+	// Jobs left in the queue can still be stolen by workers
+	std::lock_guard<std::mutex> lock(registerMutex);
+	isQueueRegistered[currentQueueIndex - getSharedQueueIndex() - 1] = false;
+	currentJobSystem = nullptr;
+	currentQueueIndex = 0;
+}
+
+unsigned int JobSystem::getQueueIndex() const
+{
+	return currentJobSystem == this ? currentQueueIndex : getSharedQueueIndex();
+}
+
+
+void JobSystem::push(Job* const* jobs, size_t count, unsigned int queueIndex)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	JobQueue& queue = *queues[queueIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.insert(queue.jobs.end(), jobs, jobs + count);
+	}
+	queuedJobs.fetch_add(count);
+
+	// Taking the lock means a worker cant miss the wake up between checking for jobs and going to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	if (count == 1)
+	{
+		sleepCondition.notify_one();
+	}
+	else
+	{
+		sleepCondition.notify_all();
+	}
+}
+
+JobSystem::Job* JobSystem::findJob(unsigned int queueIndex, const JobGroup* group)
+{
+	// Newest job from this threads own queue first, since its data is most likely to still be in cache.
+	// Every job in a registered threads queue was pushed by it, but the shared queue has jobs from other threads too
+	{
+		JobQueue& queue = *queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		Job* job = takeJob(queue.jobs, queueIndex == getSharedQueueIndex() ? group : nullptr, true);
+		if (job)
+		{
+			queuedJobs.fetch_sub(1);
+			return job;
+		}
+	}
+
+	// Then steal the oldest job from another queue, which is usually the biggest piece of work left
+	size_t queueCount = queues.size();
+	for (size_t i = 1; i < queueCount; i++)
+	{
+		JobQueue& queue = *queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		Job* job = takeJob(queue.jobs, group, false);
+		if (job)
+		{
+			queuedJobs.fetch_sub(1);
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+JobSystem::Job* JobSystem::takeJob(std::deque<Job*>& jobs, const JobGroup* group, bool isNewest)
+{
+	if (jobs.empty())
+	{
+		return nullptr;
+	}
+
+	if (!group)
+	{
+		Job* job = isNewest ? jobs.back() : jobs.front();
+		if (isNewest)
+		{
+			jobs.pop_back();
+		}
+		else
+		{
+			jobs.pop_front();
+		}
+		return job;
+	}
+
+	// Queues only hold a few jobs for each thread, so searching them is cheap
+	size_t count = jobs.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = isNewest ? count - 1 - i : i;
+		if (jobs[index]->group == group)
+		{
+			Job* job = jobs[index];
+			jobs.erase(jobs.begin() + index);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::execute(Job* job)
+{
+	job->func();
+	JobGroup& group = *job->group;
+	delete job;
+
+	// If this was the last job in its group, start everything that was waiting for it
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock(group.mutex);
+		if (group.pendingJobs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			ready.swap(group.dependents);
+		}
+	}
+	push(ready.data(), ready.size(), getQueueIndex());
+}
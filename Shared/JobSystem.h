@@ -0,0 +1,139 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+
+/// <summary>
+/// A set of worker threads that share work by stealing jobs from each other. Each thread pushes and pops jobs at the back of its own queue,
+/// and takes from the front of another threads queue when its own is empty. Threads waiting on jobs help run them instead of blocking.
+/// Threads that arent workers only help with the jobs they are waiting on, so one never picks up anothers work.
+/// With no workers, every job is run on the thread that waits for it, so results are easy to step through
+/// </summary>
+class JobSystem
+{
+	struct Job;
+
+public:
+	/// <summary>
+	/// A set of jobs that can be waited on, or that other jobs can wait for before starting.
+	/// Needs to outlive its jobs, and any jobs waiting for it
+	/// </summary>
+	class JobGroup
+	{
+	public:
+		JobGroup() : pendingJobs(0) {}
+		JobGroup(const JobGroup&) = delete;
+		JobGroup& operator=(const JobGroup&) = delete;
+
+		// Have all the jobs in this group finished?
+		bool isDone() const { return pendingJobs.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<size_t> pendingJobs;
+		// Used so jobs can be added to dependents while the last job finishes, and so wait only returns once the last job is done with the group
+		std::mutex mutex;
+		// Jobs that start once every job in this group has finished
+		std::vector<Job*> dependents;
+	};
+
+
+	JobSystem(unsigned int workerCount = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+
+	/// <summary>
+	/// Queue a job to be run by any thread
+	/// </summary>
+	/// <param name="group">The group the job is part of. Wait on it to know when the job has finished</param>
+	/// <param name="func">The work to do</param>
+	/// <param name="dependency">If not null, the job only starts once every job in this group has finished</param>
+	void run(JobGroup& group, std::function<void()> func, JobGroup* dependency = nullptr);
+	// Run jobs until every job in the group has finished
+	void wait(JobGroup& group);
+
+	/// <summary>
+	/// Call func for every index in [0, count), split into jobs of grainSize indices. The calling thread helps, and this returns once every call has finished
+	/// </summary>
+	void parallelFor(size_t count, const std::function<void(size_t)>& func, size_t grainSize = 1);
+	/// <summary>
+	/// Call func for ranges [begin, end) that together cover [0, count). Each range has at least grainSize indices, other than the last.
+	/// Use when each job can handle a whole range faster than one index at a time
+	/// </summary>
+	void parallelForRange(size_t count, const std::function<void(size_t, size_t)>& func, size_t grainSize = 1);
+
+	/// <summary>
+	/// Give the calling thread its own queue. Threads that arent workers share one queue unless they register, and can only take jobs
+	/// from the group they are waiting on from it. A thread can only be registered with one job system at a time
+	/// </summary>
+	/// <returns>False if every queue for registered threads is in use</returns>
+	bool registerThread();
+	// Give the calling threads queue back. Needs to be called before a registered thread exits
+	void unregisterThread();
+
+	unsigned int getWorkerCount() const { return (unsigned int)workers.size(); }
+
+	// How many threads that arent workers can be registered at once
+	static const unsigned int maxRegisteredThreads = 4;
+
+	// One worker for each hardware thread, leaving one for the calling thread
+	static unsigned int getDefaultWorkerCount();
+
+private:
+	struct Job
+	{
+		std::function<void()> func;
+		JobGroup* group;
+	};
+
+	// Jobs pushed by one thread. The owner uses the back and other threads steal from the front
+	struct JobQueue
+	{
+		std::mutex mutex;
+		std::deque<Job*> jobs;
+	};
+
+	void workerLoop(unsigned int queueIndex);
+	// The queue used by the calling thread. Threads that are not workers or registered share the queue after the workers
+	unsigned int getQueueIndex() const;
+	unsigned int getSharedQueueIndex() const { return sharedQueueIndex; }
+
+	// Add jobs to the back of a queue, and wake workers to take them
+	void push(Job* const* jobs, size_t count, unsigned int queueIndex);
+	/// <summary>
+	/// Take a job from the threads own queue, or steal one from another. Returns null if there are none
+	/// </summary>
+	/// <param name="group">If not null, only jobs in this group are taken, other than from a registered threads own queue</param>
+	Job* findJob(unsigned int queueIndex, const JobGroup* group = nullptr);
+	// Take the newest or oldest job in a queue, or the newest or oldest in a group if group isnt null. The queue needs to be locked
+	static Job* takeJob(std::deque<Job*>& jobs, const JobGroup* group, bool isNewest);
+	// Run a job, then start anything that was waiting for its group
+	void execute(Job* job);
+
+
+private:
+	std::vector<std::thread> workers;
+	// One queue for each worker, one shared by other threads, then one for each registered thread
+	std::vector<std::unique_ptr<JobQueue>> queues;
+	// Also the number of workers. Kept seperately, since workers use it while workers is still being filled
+	const unsigned int sharedQueueIndex;
+	// Which of the queues for registered threads are in use
+	std::mutex registerMutex;
+	bool isQueueRegistered[maxRegisteredThreads] = {};
+
+	// Jobs in queues, so idle workers know when to wake
+	std::atomic<size_t> queuedJobs;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	bool isShuttingDown = false;
+};
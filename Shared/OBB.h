@@ -6,11 +6,11 @@ class OBB : public Collider
 public:
 	OBB(raylib::Vector3 halfExtents) : halfExtents(halfExtents)
 	{
-		shapeID = 1;
+		shapeID = ShapeID<OBB>::value;
 	}
 
 
-	raylib::Matrix calculateInertiaTensor(float mass) const
+	Mat3 calculateInertiaTensor(float mass) const
 	{
 		float val = (1.f / 12.f) * mass;
 
@@ -19,15 +19,20 @@ public:
 		float y = halfExtents.y * halfExtents.y * 4;
 		float z = halfExtents.z * halfExtents.z * 4;
 
-		return {
-			val * (y + z), 0, 0, 0,
-			0, val * (x + z), 0, 0,
-			0, 0, val * (x + y), 0,
-			0, 0, 0, 1
-		};
+		return Mat3::diagonal(Vec3(val * (y + z), val * (x + z), val * (x + y)));
 	}
 
 	float getBoundingSphereRadius() const { return halfExtents.Length(); }
+	float getInnerRadius() const { return fminf(halfExtents.x, fminf(halfExtents.y, halfExtents.z)); }
+	raylib::Vector3 getWorldExtents(const raylib::Vector3 axes[3]) const
+	{
+		// Each world axis is covered by the extents projected onto it
+		return raylib::Vector3(
+			fabsf(axes[0].x) * halfExtents.x + fabsf(axes[1].x) * halfExtents.y + fabsf(axes[2].x) * halfExtents.z,
+			fabsf(axes[0].y) * halfExtents.x + fabsf(axes[1].y) * halfExtents.y + fabsf(axes[2].y) * halfExtents.z,
+			fabsf(axes[0].z) * halfExtents.x + fabsf(axes[1].z) * halfExtents.y + fabsf(axes[2].z) * halfExtents.z
+		);
+	}
 
 	raylib::Vector3 getHalfExtents() const { return halfExtents; }
 
@@ -0,0 +1,334 @@
+#pragma once
+#include "raylib-cpp.hpp"
+#include <cmath>
+
+// SSE is always available on x64, and on x86 when the compiler is told it can use it
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PHYSICS_MATH_SSE
+#include <emmintrin.h>
+#endif
+
+// Heap allocations are only 16 byte aligned on 64 bit, so only ask for alignment there. Loads dont require it either way
+#if defined(_M_X64) || defined(__x86_64__)
+#define PHYSICS_MATH_ALIGN alignas(16)
+#else
+#define PHYSICS_MATH_ALIGN
+#endif
+
+
+/// <summary>
+/// A 3D vector padded to 16 bytes, so it fits exactly in one SIMD register. Used by the physics code instead of raylib::Vector3,
+/// converting at the edges with toRaylib. The padding is always 0
+/// </summary>
+struct PHYSICS_MATH_ALIGN Vec3
+{
+	Vec3() : x(0), y(0), z(0), w(0) {}
+	Vec3(float x, float y, float z) : x(x), y(y), z(z), w(0) {}
+	Vec3(const ::Vector3& vector) : x(vector.x), y(vector.y), z(vector.z), w(0) {}
+
+	raylib::Vector3 toRaylib() const { return raylib::Vector3(x, y, z); }
+
+
+#ifdef PHYSICS_MATH_SSE
+	explicit Vec3(__m128 value) { _mm_storeu_ps(&x, value); }
+	__m128 load() const { return _mm_loadu_ps(&x); }
+
+	Vec3 operator+(const Vec3& other) const { return Vec3(_mm_add_ps(load(), other.load())); }
+	Vec3 operator-(const Vec3& other) const { return Vec3(_mm_sub_ps(load(), other.load())); }
+	Vec3 operator*(float scale) const { return Vec3(_mm_mul_ps(load(), _mm_set1_ps(scale))); }
+	Vec3 operator-() const { return Vec3(_mm_sub_ps(_mm_setzero_ps(), load())); }
+
+	// Multiply each component
+	Vec3 scaled(const Vec3& other) const { return Vec3(_mm_mul_ps(load(), other.load())); }
+
+	float dot(const Vec3& other) const
+	{
+		// Add the products pairwise, then add the pairs. The padding is 0, so adds nothing
+		__m128 product = _mm_mul_ps(load(), other.load());
+		__m128 shuffled = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(product, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+	}
+
+	Vec3 cross(const Vec3& other) const
+	{
+		// a.yzx * b.zxy - a.zxy * b.yzx, done as (a * b.yzx - a.yzx * b).yzx to save a shuffle
+		__m128 a = load();
+		__m128 b = other.load();
+		__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 result = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+		return Vec3(_mm_shuffle_ps(result, result, _MM_SHUFFLE(3, 0, 2, 1)));
+	}
+#else
+	Vec3 operator+(const Vec3& other) const { return Vec3(x + other.x, y + other.y, z + other.z); }
+	Vec3 operator-(const Vec3& other) const { return Vec3(x - other.x, y - other.y, z - other.z); }
+	Vec3 operator*(float scale) const { return Vec3(x * scale, y * scale, z * scale); }
+	Vec3 operator-() const { return Vec3(-x, -y, -z); }
+
+	// Multiply each component
+	Vec3 scaled(const Vec3& other) const { return Vec3(x * other.x, y * other.y, z * other.z); }
+
+	float dot(const Vec3& other) const { return x * other.x + y * other.y + z * other.z; }
+	Vec3 cross(const Vec3& other) const { return Vec3(y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x); }
+#endif
+
+	Vec3& operator+=(const Vec3& other) { return *this = *this + other; }
+	Vec3& operator-=(const Vec3& other) { return *this = *this - other; }
+	Vec3& operator*=(float scale) { return *this = *this * scale; }
+
+	float lengthSqr() const { return dot(*this); }
+	float length() const { return sqrtf(dot(*this)); }
+	// Returns a zero vector if this has no length
+	Vec3 normalized() const
+	{
+		float lengthSquared = lengthSqr();
+		return lengthSquared > 0 ? *this * (1 / sqrtf(lengthSquared)) : Vec3();
+	}
+
+
+	float x, y, z;
+	// Padding, so the vector fills a register
+	float w;
+};
+
+
+/// <summary>
+/// A 3x3 matrix stored as 3 column vectors. Used for rotations and inertia tensors, which never need the 4th row and column of raylib::Matrix
+/// </summary>
+struct Mat3
+{
+	// A zero matrix
+	Mat3() {}
+	Mat3(const Vec3& column0, const Vec3& column1, const Vec3& column2) :
+		columns{ column0, column1, column2 }
+	{}
+
+	static Mat3 identity() { return diagonal(Vec3(1, 1, 1)); }
+	static Mat3 diagonal(const Vec3& values) { return Mat3(Vec3(values.x, 0, 0), Vec3(0, values.y, 0), Vec3(0, 0, values.z)); }
+
+
+	// Multiply a column vector by this matrix
+	Vec3 operator*(const Vec3& vector) const
+	{
+		return columns[0] * vector.x + columns[1] * vector.y + columns[2] * vector.z;
+	}
+
+	Mat3 operator*(const Mat3& other) const
+	{
+		return Mat3(*this * other.columns[0], *this * other.columns[1], *this * other.columns[2]);
+	}
+
+	Mat3 transposed() const
+	{
+		return Mat3(
+			Vec3(columns[0].x, columns[1].x, columns[2].x),
+			Vec3(columns[0].y, columns[1].y, columns[2].y),
+			Vec3(columns[0].z, columns[1].z, columns[2].z)
+		);
+	}
+
+	// Returns a zero matrix if this one cant be inverted
+	Mat3 inverse() const
+	{
+		// The rows of the inverse are the cross products of the columns, divided by the determinant
+		Vec3 row0 = columns[1].cross(columns[2]);
+		Vec3 row1 = columns[2].cross(columns[0]);
+		Vec3 row2 = columns[0].cross(columns[1]);
+		float determinant = columns[0].dot(row0);
+		if (determinant == 0)
+		{
+			return Mat3();
+		}
+
+		float inverseDeterminant = 1 / determinant;
+		return Mat3(row0 * inverseDeterminant, row1 * inverseDeterminant, row2 * inverseDeterminant).transposed();
+	}
+
+	/// <summary>
+	/// Get this matrix rotated into another space. Equivalent to rotation * this * transpose(rotation),
+	/// used to get a world space inertia tensor from a local one
+	/// </summary>
+	Mat3 rotated(const Mat3& rotation) const
+	{
+		return rotation * *this * rotation.transposed();
+	}
+
+
+	Vec3 columns[3];
+};
+
+
+/// <summary>
+/// A rotation stored as a unit quaternion. Combining, applying, and integrating rotations as quaternions needs no trig,
+/// unlike euler angles, which are only used when sending rotations over the network
+/// </summary>
+struct PHYSICS_MATH_ALIGN Quat
+{
+	// No rotation
+	Quat() : x(0), y(0), z(0), w(1) {}
+	Quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+	/// <summary>
+	/// Create a rotation from euler angles, matching MatrixRotateXYZ
+	/// </summary>
+	static Quat fromEuler(const ::Vector3& angles)
+	{
+		// MatrixRotateXYZ(a) rotates around z, y, then x by -a, so this is qz * qy * qx with negated half angles
+		float cosX = cosf(-angles.x * 0.5f), sinX = sinf(-angles.x * 0.5f);
+		float cosY = cosf(-angles.y * 0.5f), sinY = sinf(-angles.y * 0.5f);
+		float cosZ = cosf(-angles.z * 0.5f), sinZ = sinf(-angles.z * 0.5f);
+		return Quat(
+			cosZ * cosY * sinX - sinZ * sinY * cosX,
+			cosZ * sinY * cosX + sinZ * cosY * sinX,
+			sinZ * cosY * cosX - cosZ * sinY * sinX,
+			cosZ * cosY * cosX + sinZ * sinY * sinX
+		);
+	}
+
+	// Rotate around an axis, which needs to be normalized
+	static Quat fromAxisAngle(const Vec3& axis, float angle)
+	{
+		float sinHalf = sinf(angle * 0.5f);
+		return Quat(axis.x * sinHalf, axis.y * sinHalf, axis.z * sinHalf, cosf(angle * 0.5f));
+	}
+
+	/// <summary>
+	/// Get the euler angles of this rotation, as used by MatrixRotateXYZ
+	/// </summary>
+	raylib::Vector3 toEuler() const;
+	// Get the rotation matrix, whose columns are the rotated x, y, and z axes
+	Mat3 toMatrix() const
+	{
+		float xx = x * x, yy = y * y, zz = z * z;
+		float xy = x * y, xz = x * z, yz = y * z;
+		float wx = w * x, wy = w * y, wz = w * z;
+		return Mat3(
+			Vec3(1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy)),
+			Vec3(2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx)),
+			Vec3(2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy))
+		);
+	}
+
+
+	// Combine rotations. The result applies other first, then this
+	Quat operator*(const Quat& other) const
+	{
+		return Quat(
+			w * other.x + x * other.w + y * other.z - z * other.y,
+			w * other.y - x * other.z + y * other.w + z * other.x,
+			w * other.z + x * other.y - y * other.x + z * other.w,
+			w * other.w - x * other.x - y * other.y - z * other.z
+		);
+	}
+
+	bool operator==(const Quat& other) const { return x == other.x && y == other.y && z == other.z && w == other.w; }
+	bool operator!=(const Quat& other) const { return !(*this == other); }
+
+#ifdef PHYSICS_MATH_SSE
+	explicit Quat(__m128 value) { _mm_storeu_ps(&x, value); }
+	__m128 load() const { return _mm_loadu_ps(&x); }
+
+	float dot(const Quat& other) const
+	{
+		__m128 product = _mm_mul_ps(load(), other.load());
+		__m128 shuffled = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(product, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+	}
+	Quat normalized() const
+	{
+		float lengthSquared = dot(*this);
+		return lengthSquared > 0 ? Quat(_mm_mul_ps(load(), _mm_set1_ps(1 / sqrtf(lengthSquared)))) : Quat();
+	}
+	// Blend each component, without normalizing
+	Quat blended(const Quat& other, float fraction) const
+	{
+		__m128 start = load();
+		return Quat(_mm_add_ps(start, _mm_mul_ps(_mm_sub_ps(other.load(), start), _mm_set1_ps(fraction))));
+	}
+	Quat operator-() const { return Quat(_mm_sub_ps(_mm_setzero_ps(), load())); }
+#else
+	float dot(const Quat& other) const { return x * other.x + y * other.y + z * other.z + w * other.w; }
+	Quat normalized() const
+	{
+		float lengthSquared = dot(*this);
+		if (lengthSquared <= 0)
+		{
+			return Quat();
+		}
+		float scale = 1 / sqrtf(lengthSquared);
+		return Quat(x * scale, y * scale, z * scale, w * scale);
+	}
+	// Blend each component, without normalizing
+	Quat blended(const Quat& other, float fraction) const
+	{
+		return Quat(x + (other.x - x) * fraction, y + (other.y - y) * fraction, z + (other.z - z) * fraction, w + (other.w - w) * fraction);
+	}
+	Quat operator-() const { return Quat(-x, -y, -z, -w); }
+#endif
+
+	// Rotate a vector by this rotation
+	Vec3 rotate(const Vec3& vector) const
+	{
+		// v + 2w(q x v) + 2q x (q x v)
+		Vec3 axis(x, y, z);
+		Vec3 t = axis.cross(vector) * 2;
+		return vector + t * w + axis.cross(t);
+	}
+
+	/// <summary>
+	/// Interpolate between two rotations along the shortest path. Accurate enough for the small steps between physics updates
+	/// </summary>
+	static Quat nlerp(const Quat& from, const Quat& to, float fraction)
+	{
+		// q and -q are the same rotation, so use whichever is closer
+		return from.blended(from.dot(to) < 0 ? -to : to, fraction).normalized();
+	}
+
+	/// <summary>
+	/// Rotate by an angular velocity over a period of time
+	/// </summary>
+	/// <param name="angularVelocity">The angular velocity in world space, in radians per second</param>
+	Quat integrated(const Vec3& angularVelocity, float time) const
+	{
+		float speed = angularVelocity.length();
+		if (speed * time == 0)
+		{
+			return *this;
+		}
+
+		// World space, so the step is applied after the current rotation. Normalizing stops error building up
+		return (fromAxisAngle(angularVelocity * (1 / speed), speed * time) * *this).normalized();
+	}
+
+
+	float x, y, z, w;
+};
+
+
+inline raylib::Vector3 Quat::toEuler() const
+{
+	// MatrixRotateXYZ(a) is the rotation Z * Y * X by -a, so the angles are negated
+	Mat3 matrix = toMatrix();
+	const Vec3* axes = matrix.columns;
+
+	raylib::Vector3 result;
+	float cosY = sqrtf(axes[0].x * axes[0].x + axes[0].y * axes[0].y);
+	result.y = -atan2f(-axes[0].z, cosY);
+	if (cosY > 0.000001f)
+	{
+		result.x = -atan2f(axes[1].z, axes[2].z);
+		result.z = -atan2f(axes[0].y, axes[0].x);
+	}
+	else
+	{
+		// Gimbal lock: x and z rotate around the same axis, so put all of it in z
+		result.x = 0;
+		result.z = -atan2f(-axes[1].x, axes[1].y);
+	}
+
+	return result;
+}
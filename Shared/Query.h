@@ -0,0 +1,39 @@
+#pragma once
+#include "raylib-cpp.hpp"
+
+// Forward declaration
+class StaticObject;
+
+
+/// <summary>
+/// A ray used by spatial queries. Shape casts use it as the path the shape moves along
+/// </summary>
+struct RaycastQuery
+{
+	raylib::Vector3 origin;
+	// Needs to be normalized
+	raylib::Vector3 direction;
+	// How far along the ray to search. Shape casts need this to be finite
+	float maxDistance = INFINITY;
+
+	// Only objects with a collision category in the mask are hit
+	unsigned int mask = 0xFFFFFFFF;
+	// An object that is never hit, such as the object firing the ray
+	const StaticObject* ignoredObject = nullptr;
+};
+
+/// <summary>
+/// The result of a raycast or shape cast
+/// </summary>
+struct QueryHit
+{
+	// The object hit, or null if nothing was hit
+	StaticObject* object = nullptr;
+
+	// The point hit in world space
+	raylib::Vector3 point;
+	// The surface normal at the point, pointing out of the object hit
+	raylib::Vector3 normal;
+	// How far along the ray the hit was
+	float distance = 0;
+};
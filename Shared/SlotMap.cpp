@@ -0,0 +1,131 @@
+#include "SlotMap.h"
+
+
+unsigned int SlotMap::getNextID() const
+{
+	// Slots taken by IDs from another slot map may still be queued, so find the first one that is actually free
+	for (unsigned int index : freeSlots)
+	{
+		if (slots[index].denseIndex == -1)
+		{
+			return makeID(index, slots[index].generation);
+		}
+	}
+
+	// No free slots, so a new one will be added
+	return makeID((unsigned int)slots.size(), 1);
+}
+
+bool SlotMap::insert(unsigned int id)
+{
+	unsigned int index = id & indexMask;
+	unsigned int generation = id >> indexBits;
+	if (generation == 0 || (id & reservedBit) != 0)
+	{
+		return false;
+	}
+
+	// IDs from another slot map can be past the end
+	if (index >= slots.size())
+	{
+		slots.resize(index + 1);
+	}
+
+	Slot& slot = slots[index];
+	if (slot.denseIndex != -1)
+	{
+		return false;
+	}
+
+	slot.generation = generation;
+	slot.denseIndex = (int)denseIDs.size();
+	denseIDs.push_back(id);
+
+	// Drop any slots at the front of the queue that are no longer free, including this one
+	while (!freeSlots.empty() && slots[freeSlots.front()].denseIndex != -1)
+	{
+		slots[freeSlots.front()].isQueued = false;
+		freeSlots.pop_front();
+	}
+
+	return true;
+}
+
+int SlotMap::remove(unsigned int id)
+{
+	int denseIndex = find(id);
+	if (denseIndex == -1)
+	{
+		return -1;
+	}
+
+	// Move the last ID into the gap
+	unsigned int lastID = denseIDs.back();
+	denseIDs[denseIndex] = lastID;
+	slots[lastID & indexMask].denseIndex = denseIndex;
+	denseIDs.pop_back();
+
+	// Free the slot, changing its generation so the old ID is no longer valid
+	Slot& slot = slots[id & indexMask];
+	slot.denseIndex = -1;
+	slot.generation = (slot.generation + 1) & generationMask;
+	if (slot.generation == 0)
+	{
+		slot.generation = 1;
+	}
+
+	if (!slot.isQueued)
+	{
+		freeSlots.push_back(id & indexMask);
+		slot.isQueued = true;
+	}
+
+	return denseIndex;
+}
+
+void SlotMap::clear()
+{
+	while (!denseIDs.empty())
+	{
+		remove(denseIDs.back());
+	}
+}
+
+
+unsigned int SlotMap::getSlotID(unsigned int id) const
+{
+	unsigned int index = id & indexMask;
+	if (index >= slots.size() || slots[index].denseIndex == -1)
+	{
+		return invalidID;
+	}
+
+	return makeID(index, slots[index].generation);
+}
+
+bool SlotMap::isNewer(unsigned int id, unsigned int otherID)
+{
+	// Generation 0 is skipped, so there are generationMask generations in each cycle
+	unsigned int generation = id >> indexBits;
+	unsigned int otherGeneration = otherID >> indexBits;
+	unsigned int difference = (generation + generationMask - otherGeneration) % generationMask;
+	return difference != 0 && difference < generationMask / 2;
+}
+
+
+int SlotMap::find(unsigned int id) const
+{
+	unsigned int index = id & indexMask;
+	if (index >= slots.size())
+	{
+		return -1;
+	}
+
+	const Slot& slot = slots[index];
+	if (slot.denseIndex == -1 || slot.generation != id >> indexBits)
+	{
+		return -1;
+	}
+
+	return slot.denseIndex;
+}
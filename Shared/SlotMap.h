@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+
+/// <summary>
+/// Gives out IDs and maps them to indices in a dense array, so data can be stored contiguously and still be found by ID in constant time.
+/// Removing an ID moves the last element into the gap, so owners keep their arrays in the same order as the slot map.
+/// IDs contain a generation that changes each time a slot is reused, so an old ID will not find the element that replaced it
+/// </summary>
+class SlotMap
+{
+public:
+	// The ID the next call to insert should use, if IDs come from this slot map. Freed slots are reused oldest first, so an ID takes as long as possible to come back
+	unsigned int getNextID() const;
+	/// <summary>
+	/// Add an ID to the end of the dense array. Can be getNextID, or an ID given out by another slot map, such as the servers on a client
+	/// </summary>
+	/// <returns>False if the ID is invalid or already in use</returns>
+	bool insert(unsigned int id);
+	/// <summary>
+	/// Remove an ID. The last element of the dense array is moved to the removed index, so owners should do the same
+	/// </summary>
+	/// <returns>The dense index the ID used, or -1 if it was not found</returns>
+	int remove(unsigned int id);
+	// Remove every ID. Generations are kept, so old IDs still will not be found
+	void clear();
+
+	// Get the dense index of an ID, or -1 if it is not in use
+	int find(unsigned int id) const;
+	bool contains(unsigned int id) const { return find(id) != -1; }
+	// Get the ID at a dense index
+	unsigned int getID(size_t denseIndex) const { return denseIDs[denseIndex]; }
+	// Get the ID using the same slot as an ID, which can be another generation. Returns invalidID if the slot is free
+	unsigned int getSlotID(unsigned int id) const;
+	// Is id a later generation of the same slot than otherID? Generations wrap around, so only IDs close in generation can be compared
+	static bool isNewer(unsigned int id, unsigned int otherID);
+
+	size_t size() const { return denseIDs.size(); }
+	bool empty() const { return denseIDs.empty(); }
+
+	// Never given out, so can be used for no object
+	static const unsigned int invalidID = 0;
+	// Never set in an ID, so owners can set it to keep other keys seperate from IDs
+	static const unsigned int reservedBit = 0x80000000u;
+
+private:
+	// IDs are [reserved : 1, generation : 11, slot index : 20]. Generation 0 is never used, so no ID is 0
+	static const unsigned int indexBits = 20;
+	static const unsigned int indexMask = (1u << indexBits) - 1;
+	static const unsigned int generationMask = (1u << (31 - indexBits)) - 1;
+
+	struct Slot
+	{
+		unsigned int generation = 1;
+		// -1 when the slot is free
+		int denseIndex = -1;
+		// Is the slot in freeSlots? Slots taken by an ID from another slot map can stay in it, and are skipped
+		bool isQueued = false;
+	};
+
+	static unsigned int makeID(unsigned int index, unsigned int generation) { return (generation << indexBits) | index; }
+
+
+private:
+	std::vector<Slot> slots;
+	// Free slots, oldest first
+	std::deque<unsigned int> freeSlots;
+	// The ID using each dense index
+	std::vector<unsigned int> denseIDs;
+};
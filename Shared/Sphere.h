@@ -6,24 +6,20 @@ class Sphere : public Collider
 public:
 	Sphere(float radius) : radius(radius)
 	{
-		shapeID = 0;
+		shapeID = ShapeID<Sphere>::value;
 	}
 
 
-	raylib::Matrix calculateInertiaTensor(float mass) const
+	Mat3 calculateInertiaTensor(float mass) const
 	{
 		// The moment of inertia for a solid sphere
 		float inertia = 2.f / 5.f * mass * radius * radius;
 
-		return {
-			inertia, 0, 0, 0,
-			0, inertia, 0, 0,
-			0, 0, inertia, 0,
-			0, 0, 0, 1
-		};
+		return Mat3::diagonal(Vec3(inertia, inertia, inertia));
 	}
 
 	float getBoundingSphereRadius() const { return radius; }
+	float getInnerRadius() const { return radius; }
 
 	float getRadius() const { return radius; }
 
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// A fixed size queue that one thread pushes to and another pops from, without locks.
+/// Each side only writes its own index, so the only synchronisation is an acquire and release on the other sides index
+/// </summary>
+template<class Type>
+class SpscQueue
+{
+public:
+	/// <param name="capacity">The most elements the queue can hold. Rounded up to a power of 2</param>
+	SpscQueue(size_t capacity = 1024) :
+		head(0), tail(0)
+	{
+		size_t size = 2;
+		while (size < capacity)
+		{
+			size *= 2;
+		}
+		buffer.resize(size);
+		mask = size - 1;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+
+	/// <summary>
+	/// Add an element to the end of the queue. Only call from the producing thread
+	/// </summary>
+	/// <returns>False if the queue is full</returns>
+	bool push(const Type& element)
+	{
+		size_t currentTail = tail.load(std::memory_order_relaxed);
+		if (currentTail - head.load(std::memory_order_acquire) > mask)
+		{
+			return false;
+		}
+
+		buffer[currentTail & mask] = element;
+		// Release, so the consumer sees the element once it sees the new tail
+		tail.store(currentTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// <summary>
+	/// Take the element at the front of the queue. Only call from the consuming thread
+	/// </summary>
+	/// <returns>False if the queue is empty</returns>
+	bool pop(Type& elementOut)
+	{
+		size_t currentHead = head.load(std::memory_order_relaxed);
+		if (currentHead == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		elementOut = buffer[currentHead & mask];
+		// Release, so the producer doesnt overwrite the slot until it has been read
+		head.store(currentHead + 1, std::memory_order_release);
+		return true;
+	}
+
+
+private:
+	std::vector<Type> buffer;
+	size_t mask;
+
+	// The consumer moves head and the producer moves tail. Kept on seperate cache lines, so each thread doesnt slow the other down
+	std::atomic<size_t> head;
+	char headPadding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> tail;
+	char tailPadding[64 - sizeof(std::atomic<size_t>)];
+};
@@ -0,0 +1,445 @@
+#include "StateQuantizer.h"
+#include "GameObject.h"
+#include <cmath>
+#include <cstring>
+
+// Profile indices are written with a fixed number of bits
+static const int profileIndexBits = 4;
+static_assert(StateQuantizer::maxProfiles <= (1u << profileIndexBits), "Profile indices need to fit in profileIndexBits");
+
+// More bits than this would be lost to float precision anyway
+static const int maxBits = 24;
+
+// The three smallest components of a normalized quaternion are always within this range
+static const float maxSmallestComponent = 0.70710678f;
+
+
+QuantizationProfile QuantizationProfile::standard(const raylib::Vector3& boundsMin, const raylib::Vector3& boundsMax)
+{
+	QuantizationProfile profile;
+	profile.positionBits = 18;
+	profile.boundsMin = boundsMin;
+	profile.boundsMax = boundsMax;
+	profile.rotationBits = 11;
+	profile.velocityBits = 16;
+	profile.angularVelocityBits = 16;
+	return profile;
+}
+
+
+StateQuantizer::StateQuantizer()
+{
+	// Index 0 is full precision, used by any type without a profile
+	profiles.push_back(QuantizationProfile());
+}
+
+
+unsigned int StateQuantizer::addProfile(const QuantizationProfile& profile)
+{
+	if (profiles.size() >= maxProfiles)
+	{
+		return 0;
+	}
+
+	// Keep bit counts to what can be written and read back. Signed values need a bit for the sign, so use at least 2
+	auto clampBits = [](int bits) { return bits <= 0 ? 0 : bits < 2 ? 2 : bits > maxBits ? maxBits : bits; };
+	QuantizationProfile clamped = profile;
+	clamped.positionBits = clampBits(profile.positionBits);
+	clamped.rotationBits = clampBits(profile.rotationBits);
+	clamped.velocityBits = clampBits(profile.velocityBits);
+	clamped.angularVelocityBits = clampBits(profile.angularVelocityBits);
+
+	profiles.push_back(clamped);
+	return (unsigned int)profiles.size() - 1;
+}
+
+void StateQuantizer::setTypeProfile(int typeID, unsigned int profileIndex)
+{
+	if (profileIndex < profiles.size())
+	{
+		typeProfiles[typeID] = profileIndex;
+	}
+}
+
+unsigned int StateQuantizer::getTypeProfile(int typeID) const
+{
+	auto it = typeProfiles.find(typeID);
+	return it != typeProfiles.end() ? it->second : 0;
+}
+
+
+QuantizedState StateQuantizer::quantize(int typeID, const raylib::Vector3& position, const Quat& rotation, const raylib::Vector3& velocity, const raylib::Vector3& angularVelocity) const
+{
+	QuantizedState state;
+	state.profile = getTypeProfile(typeID);
+	const QuantizationProfile& profile = profiles[state.profile];
+	unsigned int* values = state.values;
+
+	// Position is relitive to the bounds, so every bit is used for the area objects can be in
+	if (profile.positionBits > 0)
+	{
+		values[0] = quantizeUnsigned(position.x, profile.boundsMin.x, profile.boundsMax.x, profile.positionBits);
+		values[1] = quantizeUnsigned(position.y, profile.boundsMin.y, profile.boundsMax.y, profile.positionBits);
+		values[2] = quantizeUnsigned(position.z, profile.boundsMin.z, profile.boundsMax.z, profile.positionBits);
+	}
+	else
+	{
+		quantizeVector(position, 0, 0, &values[0]);
+	}
+
+	if (profile.rotationBits > 0)
+	{
+		// Smallest three. The largest component is left out, and rebuilt from the others since the quaternion has a length of 1
+		Quat normalized = rotation.normalized();
+		float components[4] = { normalized.x, normalized.y, normalized.z, normalized.w };
+		unsigned int largest = 0;
+		for (unsigned int i = 1; i < 4; i++)
+		{
+			if (fabsf(components[i]) > fabsf(components[largest]))
+			{
+				largest = i;
+			}
+		}
+
+		// A quaternion and its negative are the same rotation, so flip it to make the largest positive, and its sign doesnt need sending
+		float sign = components[largest] < 0 ? -1.0f : 1.0f;
+		values[3] = largest;
+		int next = 4;
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (i != largest)
+			{
+				values[next++] = quantizeSigned(components[i] * sign, maxSmallestComponent, profile.rotationBits);
+			}
+		}
+	}
+	else
+	{
+		quantizeVector(rotation.toEuler(), 0, 0, &values[4]);
+	}
+
+	quantizeVector(velocity, profile.maxVelocity, profile.velocityBits, &values[7]);
+	quantizeVector(angularVelocity, profile.maxAngularVelocity, profile.angularVelocityBits, &values[10]);
+	return state;
+}
+
+bool StateQuantizer::dequantize(const QuantizedState& state, PhysicsState& stateOut) const
+{
+	if (state.profile >= profiles.size())
+	{
+		return false;
+	}
+	const QuantizationProfile& profile = profiles[state.profile];
+	const unsigned int* values = state.values;
+
+	if (profile.positionBits > 0)
+	{
+		stateOut.position.x = dequantizeUnsigned(values[0], profile.boundsMin.x, profile.boundsMax.x, profile.positionBits);
+		stateOut.position.y = dequantizeUnsigned(values[1], profile.boundsMin.y, profile.boundsMax.y, profile.positionBits);
+		stateOut.position.z = dequantizeUnsigned(values[2], profile.boundsMin.z, profile.boundsMax.z, profile.positionBits);
+	}
+	else
+	{
+		stateOut.position = dequantizeVector(&values[0], 0, 0);
+	}
+
+	if (profile.rotationBits > 0)
+	{
+		unsigned int largest = values[3] & 3;
+		float components[4];
+		float lengthSquared = 0;
+		int next = 4;
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			if (i != largest)
+			{
+				components[i] = dequantizeSigned(values[next++], maxSmallestComponent, profile.rotationBits);
+				lengthSquared += components[i] * components[i];
+			}
+		}
+		components[largest] = sqrtf(lengthSquared < 1 ? 1 - lengthSquared : 0);
+
+		stateOut.rotation = Quat(components[0], components[1], components[2], components[3]).normalized().toEuler();
+	}
+	else
+	{
+		stateOut.rotation = dequantizeVector(&values[4], 0, 0);
+	}
+
+	stateOut.velocity = dequantizeVector(&values[7], profile.maxVelocity, profile.velocityBits);
+	stateOut.angularVelocity = dequantizeVector(&values[10], profile.maxAngularVelocity, profile.angularVelocityBits);
+	return true;
+}
+
+
+void StateQuantizer::write(RakNet::BitStream& bs, const QuantizedState& state) const
+{
+	const QuantizationProfile& profile = profiles[state.profile];
+	bs.WriteBitsFromIntegerRange(state.profile, 0u, maxProfiles - 1, profileIndexBits);
+
+	for (int i = 0; i < QuantizedState::valueCount; i++)
+	{
+		int bits = getValueBits(profile, i);
+		if (bits > 0)
+		{
+			bs.WriteBitsFromIntegerRange(state.values[i], 0u, 0xFFFFFFFFu, bits);
+		}
+	}
+}
+
+bool StateQuantizer::read(RakNet::BitStream& bsIn, QuantizedState& stateOut) const
+{
+	stateOut = QuantizedState();
+	if (!bsIn.ReadBitsFromIntegerRange(stateOut.profile, 0u, maxProfiles - 1, profileIndexBits) || stateOut.profile >= profiles.size())
+	{
+		return false;
+	}
+	const QuantizationProfile& profile = profiles[stateOut.profile];
+
+	for (int i = 0; i < QuantizedState::valueCount; i++)
+	{
+		int bits = getValueBits(profile, i);
+		if (bits > 0 && !bsIn.ReadBitsFromIntegerRange(stateOut.values[i], 0u, 0xFFFFFFFFu, bits))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// The values that make up each part of the state, as [first, last)
+static const int fieldStarts[] = { 0, 3, 7, 10, QuantizedState::valueCount };
+static const int fieldCount = 4;
+
+// Values with this many bits or fewer are written as they are, since a difference would not be any smaller
+static const int maxRawBits = 4;
+
+// The number of bits needed to write a number between 0 and value
+static int getBitLength(unsigned long long value)
+{
+	int length = 0;
+	while (value > 0)
+	{
+		value >>= 1;
+		length++;
+	}
+	return length;
+}
+
+void StateQuantizer::writeDelta(RakNet::BitStream& bs, const QuantizedState& state, const QuantizedState& baseline) const
+{
+	const QuantizationProfile& profile = profiles[state.profile];
+	QuantizedState zero;
+	zero.profile = state.profile;
+	const QuantizedState& base = baseline.profile == state.profile ? baseline : zero;
+	bs.WriteBitsFromIntegerRange(state.profile, 0u, maxProfiles - 1, profileIndexBits);
+
+	for (int field = 0; field < fieldCount; field++)
+	{
+		// One bit says if any value in the part changed. Unchanged parts arent sent
+		bool hasChanged = false;
+		for (int i = fieldStarts[field]; i < fieldStarts[field + 1]; i++)
+		{
+			hasChanged |= state.values[i] != base.values[i];
+		}
+		bs.Write(hasChanged);
+		if (!hasChanged)
+		{
+			continue;
+		}
+
+		for (int i = fieldStarts[field]; i < fieldStarts[field + 1]; i++)
+		{
+			int bits = getValueBits(profile, i);
+			if (bits == 0)
+			{
+				continue;
+			}
+			if (bits <= maxRawBits)
+			{
+				bs.WriteBitsFromIntegerRange(state.values[i], 0u, 0xFFFFFFFFu, bits);
+				continue;
+			}
+
+			// The difference wraps around within the values bits, then is zig zag encoded so small changes either way become small numbers
+			unsigned long long range = 1ull << bits;
+			unsigned long long difference = (state.values[i] - (unsigned long long)base.values[i]) & (range - 1);
+			long long signedDifference = difference >= range / 2 ? (long long)difference - (long long)range : (long long)difference;
+			unsigned long long zigZag = signedDifference >= 0 ? (unsigned long long)signedDifference * 2 : (unsigned long long)(-signedDifference) * 2 - 1;
+
+			// Write how many bits the difference needs, then the difference
+			int length = getBitLength(zigZag);
+			bs.WriteBitsFromIntegerRange((unsigned int)length, 0u, (unsigned int)bits, getBitLength(bits));
+			if (length > 0)
+			{
+				bs.WriteBitsFromIntegerRange((unsigned int)zigZag, 0u, 0xFFFFFFFFu, length);
+			}
+		}
+	}
+}
+
+bool StateQuantizer::readDelta(RakNet::BitStream& bsIn, const QuantizedState& baseline, QuantizedState& stateOut) const
+{
+	unsigned int profileIndex = 0;
+	if (!bsIn.ReadBitsFromIntegerRange(profileIndex, 0u, maxProfiles - 1, profileIndexBits) || profileIndex >= profiles.size())
+	{
+		return false;
+	}
+	const QuantizationProfile& profile = profiles[profileIndex];
+
+	// Start from the baseline, so parts that didnt change keep its values
+	if (baseline.profile == profileIndex)
+	{
+		stateOut = baseline;
+	}
+	else
+	{
+		stateOut = QuantizedState();
+		stateOut.profile = profileIndex;
+	}
+
+	for (int field = 0; field < fieldCount; field++)
+	{
+		bool hasChanged;
+		if (!bsIn.Read(hasChanged))
+		{
+			return false;
+		}
+		if (!hasChanged)
+		{
+			continue;
+		}
+
+		for (int i = fieldStarts[field]; i < fieldStarts[field + 1]; i++)
+		{
+			int bits = getValueBits(profile, i);
+			if (bits == 0)
+			{
+				continue;
+			}
+			if (bits <= maxRawBits)
+			{
+				if (!bsIn.ReadBitsFromIntegerRange(stateOut.values[i], 0u, 0xFFFFFFFFu, bits))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			unsigned int length = 0;
+			unsigned int zigZag = 0;
+			if (!bsIn.ReadBitsFromIntegerRange(length, 0u, (unsigned int)bits, getBitLength(bits)) || (int)length > bits ||
+				(length > 0 && !bsIn.ReadBitsFromIntegerRange(zigZag, 0u, 0xFFFFFFFFu, (int)length)))
+			{
+				return false;
+			}
+
+			unsigned long long range = 1ull << bits;
+			long long signedDifference = (zigZag & 1) ? -(long long)((zigZag + 1ull) / 2) : (long long)(zigZag / 2);
+			stateOut.values[i] = (unsigned int)(((unsigned long long)stateOut.values[i] + (unsigned long long)signedDifference) & (range - 1));
+		}
+	}
+	return true;
+}
+
+
+void StateQuantizer::write(RakNet::BitStream& bs, int typeID, const raylib::Vector3& position, const Quat& rotation, const raylib::Vector3& velocity, const raylib::Vector3& angularVelocity) const
+{
+	write(bs, quantize(typeID, position, rotation, velocity, angularVelocity));
+}
+
+bool StateQuantizer::read(RakNet::BitStream& bsIn, PhysicsState& stateOut) const
+{
+	QuantizedState state;
+	return read(bsIn, state) && dequantize(state, stateOut);
+}
+
+
+int StateQuantizer::getValueBits(const QuantizationProfile& profile, int valueIndex)
+{
+	// Parts without bits are sent as full floats
+	if (valueIndex < 3)
+	{
+		return profile.positionBits > 0 ? profile.positionBits : 32;
+	}
+	if (valueIndex == 3)
+	{
+		return profile.rotationBits > 0 ? 2 : 0;
+	}
+	if (valueIndex < 7)
+	{
+		return profile.rotationBits > 0 ? profile.rotationBits : 32;
+	}
+	if (valueIndex < 10)
+	{
+		return profile.velocityBits > 0 ? profile.velocityBits : 32;
+	}
+	return profile.angularVelocityBits > 0 ? profile.angularVelocityBits : 32;
+}
+
+
+unsigned int StateQuantizer::quantizeUnsigned(float value, float min, float max, int bits)
+{
+	unsigned int levels = (1u << bits) - 1;
+	float fraction = max > min ? (value - min) / (max - min) : 0;
+	fraction = fraction < 0 ? 0 : fraction > 1 ? 1 : fraction;
+
+	return (unsigned int)(fraction * levels + 0.5f);
+}
+
+float StateQuantizer::dequantizeUnsigned(unsigned int value, float min, float max, int bits)
+{
+	unsigned int levels = (1u << bits) - 1;
+	return min + (max - min) * ((float)value / levels);
+}
+
+unsigned int StateQuantizer::quantizeSigned(float value, float max, int bits)
+{
+	// Levels are spread evenly either side of zero, so zero is written exactly
+	int levels = (1 << (bits - 1)) - 1;
+	float fraction = max > 0 ? value / max : 0;
+	fraction = fraction < -1 ? -1 : fraction > 1 ? 1 : fraction;
+
+	return (unsigned int)((int)roundf(fraction * levels) + levels);
+}
+
+float StateQuantizer::dequantizeSigned(unsigned int value, float max, int bits)
+{
+	int levels = (1 << (bits - 1)) - 1;
+	return max * ((float)((int)value - levels) / levels);
+}
+
+
+void StateQuantizer::quantizeVector(const raylib::Vector3& vector, float max, int bits, unsigned int* valuesOut)
+{
+	const float axes[3] = { vector.x, vector.y, vector.z };
+	for (int i = 0; i < 3; i++)
+	{
+		if (bits > 0)
+		{
+			valuesOut[i] = quantizeSigned(axes[i], max, bits);
+		}
+		else
+		{
+			memcpy(&valuesOut[i], &axes[i], sizeof(float));
+		}
+	}
+}
+
+raylib::Vector3 StateQuantizer::dequantizeVector(const unsigned int* values, float max, int bits)
+{
+	float axes[3];
+	for (int i = 0; i < 3; i++)
+	{
+		if (bits > 0)
+		{
+			axes[i] = dequantizeSigned(values[i], max, bits);
+		}
+		else
+		{
+			memcpy(&axes[i], &values[i], sizeof(float));
+		}
+	}
+	return raylib::Vector3(axes[0], axes[1], axes[2]);
+}
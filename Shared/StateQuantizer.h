@@ -0,0 +1,114 @@
+#pragma once
+#include "raylib-cpp.hpp"
+#include "PhysicsMath.h"
+#include <BitStream.h>
+#include <vector>
+#include <unordered_map>
+
+struct PhysicsState;
+
+
+/// <summary>
+/// How precisely each part of a physics state is sent. Parts with 0 bits are sent as full floats
+/// </summary>
+struct QuantizationProfile
+{
+	// Bits for each axis of position, stored as fixed point between boundsMin and boundsMax. Positions outside the bounds are clamped
+	int positionBits = 0;
+	raylib::Vector3 boundsMin = { -512, -512, -512 };
+	raylib::Vector3 boundsMax = { 512, 512, 512 };
+
+	// Bits for each of the three smallest components of the rotation. The largest is rebuilt from them
+	int rotationBits = 0;
+
+	// Bits for each axis of velocity and angular velocity, between plus and minus their max. Zero is always exact, so resting objects stay still
+	int velocityBits = 0;
+	float maxVelocity = 64;
+	int angularVelocityBits = 0;
+	float maxAngularVelocity = 32;
+
+
+	/// <summary>
+	/// A profile suitable for most objects. Under half a centimetre of position error in a 1 km world,
+	/// about a tenth of a degree of rotation error, and 16 bit velocities
+	/// </summary>
+	static QuantizationProfile standard(const raylib::Vector3& boundsMin = { -512, -512, -512 }, const raylib::Vector3& boundsMax = { 512, 512, 512 });
+};
+
+
+/// <summary>
+/// A physics state after quantization, as the whole numbers that are sent. Comparing these instead of floats means the server and
+/// clients agree exactly on what was sent, so later updates can be sent as differences from it
+/// </summary>
+struct QuantizedState
+{
+	// Position, then rotation (the index of the largest component, then the other three), then velocity, then angular velocity.
+	// Parts sent as full floats store the bits of the float, and rotations sent as euler angles leave the index as 0
+	static const int valueCount = 13;
+
+	unsigned int profile = 0;
+	unsigned int values[valueCount] = {};
+};
+
+
+/// <summary>
+/// Writes and reads physics states for object updates, using the quantization profile set for each object type.
+/// The server and clients need to add the same profiles in the same order, and should do so before connecting
+/// </summary>
+class StateQuantizer
+{
+public:
+	// The most profiles that can be added, including the full precision profile every type starts with
+	static const unsigned int maxProfiles = 16;
+
+	StateQuantizer();
+
+
+	// Add a profile, returning its index. Returns 0, the full precision profile, if there are already maxProfiles
+	unsigned int addProfile(const QuantizationProfile& profile);
+	// Use a profile for every object with the type ID. Types without one use full precision
+	void setTypeProfile(int typeID, unsigned int profileIndex);
+	unsigned int getTypeProfile(int typeID) const;
+	const QuantizationProfile& getProfile(unsigned int profileIndex) const { return profiles[profileIndex]; }
+
+	// Quantize a physics state using the profile for the type
+	QuantizedState quantize(int typeID, const raylib::Vector3& position, const Quat& rotation, const raylib::Vector3& velocity, const raylib::Vector3& angularVelocity) const;
+	// Turn a quantized state back into a physics state, with the rotation as euler angles. Returns false if the profile is unknown
+	bool dequantize(const QuantizedState& state, PhysicsState& stateOut) const;
+
+	// Write a whole quantized state. The profile index is written first, so it can be read without knowing the object
+	void write(RakNet::BitStream& bs, const QuantizedState& state) const;
+	// Read a state written by write. Returns false if the stream ran out or the profile is unknown
+	bool read(RakNet::BitStream& bsIn, QuantizedState& stateOut) const;
+
+	/// <summary>
+	/// Write a state as the difference from a baseline the reader also has. Only parts that changed are sent, as the difference of each value.
+	/// If the baseline uses a different profile, the state is sent as the difference from zero
+	/// </summary>
+	void writeDelta(RakNet::BitStream& bs, const QuantizedState& state, const QuantizedState& baseline) const;
+	// Read a state written by writeDelta, using the same baseline. Returns false if the stream ran out or the profile is unknown
+	bool readDelta(RakNet::BitStream& bsIn, const QuantizedState& baseline, QuantizedState& stateOut) const;
+
+	// Quantize and write a physics state using the profile for the type
+	void write(RakNet::BitStream& bs, int typeID, const raylib::Vector3& position, const Quat& rotation, const raylib::Vector3& velocity, const raylib::Vector3& angularVelocity) const;
+	// Read a physics state written by write. The rotation is returned as euler angles. Returns false if the stream ran out or the profile is unknown
+	bool read(RakNet::BitStream& bsIn, PhysicsState& stateOut) const;
+
+private:
+	// The number of bits each value is written with for a profile. Values with 0 bits are not written
+	static int getValueBits(const QuantizationProfile& profile, int valueIndex);
+
+	static unsigned int quantizeUnsigned(float value, float min, float max, int bits);
+	static float dequantizeUnsigned(unsigned int value, float min, float max, int bits);
+	static unsigned int quantizeSigned(float value, float max, int bits);
+	static float dequantizeSigned(unsigned int value, float max, int bits);
+	// Quantize each axis of a vector into values, or store the bits of each float if bits is 0
+	static void quantizeVector(const raylib::Vector3& vector, float max, int bits, unsigned int* valuesOut);
+	static raylib::Vector3 dequantizeVector(const unsigned int* values, float max, int bits);
+
+
+private:
+	std::vector<QuantizationProfile> profiles;
+	// <type ID, profile index>
+	std::unordered_map<int, unsigned int> typeProfiles;
+};
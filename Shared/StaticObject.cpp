@@ -2,11 +2,11 @@
 
 
 StaticObject::StaticObject() :
-	position(0,0,0), rotation(0,0,0), collider(nullptr)
+	collider(nullptr), detachedPosition(0,0,0)
 {}
 
 StaticObject::StaticObject(raylib::Vector3 position, raylib::Vector3 rotation, Collider* collider) :
-	position(position), rotation(rotation), collider(collider)
+	collider(collider), detachedPosition(position), detachedRotation(Quat::fromEuler(rotation))
 {}
 
 StaticObject::~StaticObject()
@@ -20,7 +20,7 @@ StaticObject::~StaticObject()
 
 void StaticObject::serialize(RakNet::BitStream& bs) const
 {
-	// [typeID, collider info, position, rotation]
+	// [typeID, collider info, position, rotation, collision category, collision mask]
 	bs.Write(typeID);
 
 	// Try to write the collider. If we dont have one, use an invalid shape ID
@@ -29,6 +29,43 @@ void StaticObject::serialize(RakNet::BitStream& bs) const
 	else
 		bs.Write(-1);
 
-	bs.Write(position);
-	bs.Write(rotation);
+	bs.Write(position());
+	bs.Write(getRotation());
+	bs.Write(collisionCategory);
+	bs.Write(collisionMask);
 }
+
+
+const WorldTransform& StaticObject::getTransform() const
+{
+	updateTransform();
+	return transform;
+}
+
+void StaticObject::updateTransform() const
+{
+	// Position and rotation are set directly by derived classes, so compare against the values the cache was made with
+	const raylib::Vector3& currentPosition = position();
+	const Quat& currentRotation = rotation();
+	if (hasTransform && transformPosition == currentPosition && transformRotation == currentRotation)
+	{
+		return;
+	}
+
+	// Only recalculate the rotation if it has changed
+	if (!hasTransform || transformRotation != currentRotation)
+	{
+		transform.rotation = currentRotation.toMatrix();
+		for (int i = 0; i < 3; i++)
+		{
+			transform.axes[i] = transform.rotation.columns[i].toRaylib();
+		}
+	}
+
+	raylib::Vector3 extents = collider ? collider->getWorldExtents(transform.axes) : raylib::Vector3(0, 0, 0);
+	transform.aabb = AABB(Vector3Subtract(currentPosition, extents), Vector3Add(currentPosition, extents));
+
+	transformPosition = currentPosition;
+	transformRotation = currentRotation;
+	hasTransform = true;
+}
\ No newline at end of file
@@ -1,10 +1,28 @@
 #pragma once
 #include "raylib-cpp.hpp"
+#include "PhysicsMath.h"
 #include "Collider.h"
+#include "AABB.h"
+#include "BodyStorage.h"
 #include <BitStream.h>
 
-// Forward declaration
+// Forward declarations
 class CollisionSystem;
+class Broadphase;
+class StaticWorld;
+
+
+/// <summary>
+/// World space data used by collision detection, cached so it is only calculated when an object moves
+/// </summary>
+struct WorldTransform
+{
+	Mat3 rotation;
+	// The objects local x, y, and z axes in world space. These are the columns of rotation
+	raylib::Vector3 axes[3];
+	// A world space box containing the collider
+	AABB aabb;
+};
 
 
 /// <summary>
@@ -15,6 +33,12 @@ class StaticObject
 {
 	// Contact forces need to set the objects position directly. Instead of making a setter, make the class a friend
 	friend CollisionSystem;
+	// The broadphase keeps track of the objects proxy
+	friend Broadphase;
+	// The static world gives each static object an index
+	friend StaticWorld;
+	// Game objects keep their transform in a body storage, which moves it in and out
+	friend BodyStorage;
 public:
 	StaticObject();
 	StaticObject(raylib::Vector3 position, raylib::Vector3 rotation, Collider* collider = nullptr);
@@ -31,8 +55,35 @@ public:
 
 	Collider* getCollider() const { return collider; }
 
-	raylib::Vector3 getPosition() const { return position; }
-	raylib::Vector3 getRotation() const { return rotation; }
+	raylib::Vector3 getPosition() const { return position(); }
+	// Get the rotation in euler angles, as used by MatrixRotateXYZ. Converted from the orientation, so use that where possible
+	raylib::Vector3 getRotation() const { return rotation().toEuler(); }
+	Quat getOrientation() const { return rotation(); }
+
+	/// <summary>
+	/// Set which collision categories this object belongs to, and which categories it can collide with. 
+	/// Not syncronised after creation, so should be set before the object is sent to clients
+	/// </summary>
+	void setCollisionFilter(unsigned int category, unsigned int mask) { collisionCategory = category; collisionMask = mask; }
+	unsigned int getCollisionCategory() const { return collisionCategory; }
+	unsigned int getCollisionMask() const { return collisionMask; }
+	// Can the objects collide? Both objects need to have the others category in their mask
+	bool canCollideWith(const StaticObject* other) const
+	{
+		return (collisionCategory & other->collisionMask) != 0 && (other->collisionCategory & collisionMask) != 0;
+	}
+
+	// Get a world space box containing the objects collider
+	AABB getAABB() const { return getTransform().aabb; }
+	/// <summary>
+	/// Get the cached world transform, recalculating it if the object has moved since it was last used.
+	/// Recalculating is not thread safe, so updateTransform should be called before using this from multiple threads
+	/// </summary>
+	const WorldTransform& getTransform() const;
+	// Recalculate the world transform if the object has moved since it was last calculated
+	void updateTransform() const;
+	// The index of this object in the static world. Used to order collisions, since static objects dont have IDs
+	int getStaticIndex() const { return staticIndex; }
 
 
 	
@@ -47,6 +98,33 @@ protected:
 	// Collider used for collision
 	Collider* collider;
 
-	raylib::Vector3 position;
-	raylib::Vector3 rotation;
+	// The objects position and orientation. Game objects keep them in their body storage while they are in one, so always use these
+	raylib::Vector3& position() { return bodies ? bodies->positions[bodyIndex] : detachedPosition; }
+	const raylib::Vector3& position() const { return bodies ? bodies->positions[bodyIndex] : detachedPosition; }
+	Quat& rotation() { return bodies ? bodies->rotations[bodyIndex] : detachedRotation; }
+	const Quat& rotation() const { return bodies ? bodies->rotations[bodyIndex] : detachedRotation; }
+
+	// Bit fields of the categories this object belongs to, and the categories it can collide with
+	unsigned int collisionCategory = 1;
+	unsigned int collisionMask = 0xFFFFFFFF;
+
+	// The body storage this object is in, and its index in the storages arrays. Only game objects are put in one
+	BodyStorage* bodies = nullptr;
+	unsigned int bodyIndex = 0;
+
+private:
+	// The ID of this objects proxy in the broadphase, or -1 if it is not in one
+	int proxyID = -1;
+	// Set by StaticWorld when it is built
+	int staticIndex = -1;
+
+	// Where the transform is kept while the object is not in a body storage. Static objects always use these
+	raylib::Vector3 detachedPosition;
+	Quat detachedRotation;
+
+	// The cached world transform, and the position and rotation it was calculated with
+	mutable WorldTransform transform;
+	mutable raylib::Vector3 transformPosition;
+	mutable Quat transformRotation;
+	mutable bool hasTransform = false;
 };
\ No newline at end of file
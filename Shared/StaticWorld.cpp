@@ -0,0 +1,204 @@
+#include "StaticWorld.h"
+#include "StaticObject.h"
+#include <algorithm>
+
+
+// Get a component of a vector by its index
+static float getComponent(const raylib::Vector3& vector, int axis)
+{
+	return (axis == 0) ? vector.x : ((axis == 1) ? vector.y : vector.z);
+}
+
+void StaticWorld::build(const std::vector<StaticObject*>& staticObjects)
+{
+	clear();
+	sourceCount = staticObjects.size();
+
+	// Objects without a collider can never collide, so they are not added
+	for (unsigned int i = 0; i < staticObjects.size(); i++)
+	{
+		// Objects are given their index in the list, so they are ordered the same way they were created
+		staticObjects[i]->staticIndex = i;
+
+		if (staticObjects[i]->getCollider())
+		{
+			objects.push_back(staticObjects[i]);
+			objectBounds.push_back(staticObjects[i]->getAABB());
+		}
+	}
+
+	if (objects.empty())
+	{
+		return;
+	}
+
+	// Categories are only needed while building, and are put in order after the objects are
+	objectCategories.resize(objects.size());
+
+	// Centers of each box are used to sort objects into children
+	std::vector<raylib::Vector3> centers;
+	centers.reserve(objects.size());
+	for (unsigned int i = 0; i < objectBounds.size(); i++)
+	{
+		centers.push_back(Vector3Scale(Vector3Add(objectBounds[i].lower, objectBounds[i].upper), 0.5f));
+	}
+
+	// A binary tree has at most 2n - 1 nodes
+	nodes.reserve(objects.size() * 2);
+	nodes.emplace_back();
+	buildNode(0, 0, (int)objects.size(), 0, centers);
+}
+
+void StaticWorld::clear()
+{
+	nodes.clear();
+	objects.clear();
+	objectBounds.clear();
+	objectCategories.clear();
+	sourceCount = 0;
+}
+
+
+void StaticWorld::buildNode(int nodeID, int start, int end, int depth, std::vector<raylib::Vector3>& centers)
+{
+	// Find the bounds of every object, and of their centers
+	AABB bounds = objectBounds[start];
+	AABB centerBounds(centers[start], centers[start]);
+	for (int i = start + 1; i < end; i++)
+	{
+		bounds = AABB::combine(bounds, objectBounds[i]);
+		centerBounds = AABB::combine(centerBounds, AABB(centers[i], centers[i]));
+	}
+	nodes[nodeID].aabb = bounds;
+
+	int count = end - start;
+	if (count <= maxLeafSize)
+	{
+		makeLeaf(nodeID, start, end);
+		return;
+	}
+
+
+	// Find the best split using binned SAH. Cost is the surface area of each side multiplied by its object count
+	float bestCost = INFINITY;
+	int bestAxis = -1;
+	float bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float lower = getComponent(centerBounds.lower, axis);
+		float upper = getComponent(centerBounds.upper, axis);
+		// All centers are in the same place along this axis
+		if (upper - lower < 0.0001f)
+		{
+			continue;
+		}
+
+		AABB binBounds[binCount];
+		int binCounts[binCount] = {};
+		float scale = binCount / (upper - lower);
+		for (int i = start; i < end; i++)
+		{
+			int bin = (int)((getComponent(centers[i], axis) - lower) * scale);
+			bin = bin >= binCount ? binCount - 1 : bin;
+
+			binBounds[bin] = binCounts[bin] == 0 ? objectBounds[i] : AABB::combine(binBounds[bin], objectBounds[i]);
+			binCounts[bin]++;
+		}
+
+		// Sweep from the right to get the area and count on the right of each split
+		float rightArea[binCount];
+		int rightCount[binCount];
+		AABB accumulated;
+		int accumulatedCount = 0;
+		for (int i = binCount - 1; i > 0; i--)
+		{
+			if (binCounts[i] > 0)
+			{
+				accumulated = accumulatedCount == 0 ? binBounds[i] : AABB::combine(accumulated, binBounds[i]);
+				accumulatedCount += binCounts[i];
+			}
+			rightArea[i] = accumulatedCount > 0 ? accumulated.getSurfaceArea() : 0;
+			rightCount[i] = accumulatedCount;
+		}
+
+		// Sweep from the left, checking the cost of splitting after each bin
+		accumulatedCount = 0;
+		for (int i = 0; i < binCount - 1; i++)
+		{
+			if (binCounts[i] > 0)
+			{
+				accumulated = accumulatedCount == 0 ? binBounds[i] : AABB::combine(accumulated, binBounds[i]);
+				accumulatedCount += binCounts[i];
+			}
+			if (accumulatedCount == 0 || rightCount[i + 1] == 0)
+			{
+				continue;
+			}
+
+			float cost = accumulated.getSurfaceArea() * accumulatedCount + rightArea[i + 1] * rightCount[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = lower + (i + 1) / scale;
+			}
+		}
+	}
+
+
+	// Partition the objects around the split
+	int mid = start;
+	if (bestAxis != -1 && depth < maxDepth)
+	{
+		// If splitting costs more than testing every object, make a leaf
+		if (bestCost >= bounds.getSurfaceArea() * count && count <= maxLeafSize * 4)
+		{
+			makeLeaf(nodeID, start, end);
+			return;
+		}
+
+		for (int i = start; i < end; i++)
+		{
+			if (getComponent(centers[i], bestAxis) < bestSplit)
+			{
+				std::swap(objects[i], objects[mid]);
+				std::swap(objectBounds[i], objectBounds[mid]);
+				std::swap(centers[i], centers[mid]);
+				mid++;
+			}
+		}
+	}
+	// No useful split was found, so split the objects in half
+	if (mid == start || mid == end)
+	{
+		mid = start + count / 2;
+	}
+
+
+	// The first child goes directly after this node, and the second after all of the first childs nodes
+	int child1 = (int)nodes.size();
+	nodes.emplace_back();
+	buildNode(child1, start, mid, depth + 1, centers);
+
+	int child2 = (int)nodes.size();
+	nodes.emplace_back();
+	nodes[nodeID].index = child2;
+	nodes[nodeID].count = 0;
+	buildNode(child2, mid, end, depth + 1, centers);
+
+	nodes[nodeID].categories = nodes[child1].categories | nodes[child2].categories;
+}
+
+void StaticWorld::makeLeaf(int nodeID, int start, int end)
+{
+	nodes[nodeID].index = start;
+	nodes[nodeID].count = end - start;
+	nodes[nodeID].categories = 0;
+
+	// Objects are in their final order once they are in a leaf
+	for (int i = start; i < end; i++)
+	{
+		objectCategories[i] = objects[i]->getCollisionCategory();
+		nodes[nodeID].categories |= objectCategories[i];
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "AABB.h"
+#include <vector>
+
+// Forward declaration
+class StaticObject;
+
+
+/// <summary>
+/// An immutable bounding volume hierarchy of static objects. Static objects never move, so the tree is built 
+/// once using the surface area heuristic, and stored in a single array with children next to their parents
+/// </summary>
+class StaticWorld
+{
+public:
+	/// <summary>
+	/// Build the tree from a list of static objects, replacing any existing tree. Objects without a collider are ignored
+	/// </summary>
+	void build(const std::vector<StaticObject*>& staticObjects);
+	// Remove all objects
+	void clear();
+
+	/// <summary>
+	/// Call callback with every object whose box overlaps aabb
+	/// </summary>
+	/// <param name="mask">Only objects with a collision category in the mask are returned. Branches without one are skipped</param>
+	template<class Callback>
+	void query(const AABB& aabb, Callback callback, unsigned int mask = 0xFFFFFFFF) const
+	{
+		if (nodes.empty())
+		{
+			return;
+		}
+
+		int stack[maxDepth * 2 + 2];
+		int count = 0;
+		stack[count++] = 0;
+
+		while (count > 0)
+		{
+			int nodeID = stack[--count];
+			const Node& node = nodes[nodeID];
+			if ((node.categories & mask) == 0 || !node.aabb.overlaps(aabb))
+			{
+				continue;
+			}
+
+			if (node.count > 0)
+			{
+				// Leaf: test each object
+				for (int i = node.index; i < node.index + node.count; i++)
+				{
+					if ((objectCategories[i] & mask) != 0 && objectBounds[i].overlaps(aabb))
+					{
+						callback(objects[i]);
+					}
+				}
+			}
+			else
+			{
+				// The first child is always directly after its parent
+				stack[count++] = node.index;
+				stack[count++] = nodeID + 1;
+			}
+		}
+	}
+
+
+	/// <summary>
+	/// Call callback with every object whose box is hit by the ray. The callback returns how far along the ray to keep searching,
+	/// so returning the distance of a hit skips anything further away
+	/// </summary>
+	/// <param name="mask">Only objects with a collision category in the mask are returned</param>
+	template<class Callback>
+	void raycast(const raylib::Vector3& origin, const raylib::Vector3& direction, float maxDistance, Callback callback, unsigned int mask = 0xFFFFFFFF) const
+	{
+		if (nodes.empty())
+		{
+			return;
+		}
+
+		raylib::Vector3 inverseDirection(1 / direction.x, 1 / direction.y, 1 / direction.z);
+		int stack[maxDepth * 2 + 2];
+		int count = 0;
+		stack[count++] = 0;
+
+		while (count > 0)
+		{
+			int nodeID = stack[--count];
+			const Node& node = nodes[nodeID];
+			if ((node.categories & mask) == 0 || !node.aabb.intersectsRay(origin, inverseDirection, maxDistance))
+			{
+				continue;
+			}
+
+			if (node.count > 0)
+			{
+				for (int i = node.index; i < node.index + node.count; i++)
+				{
+					if ((objectCategories[i] & mask) != 0 && objectBounds[i].intersectsRay(origin, inverseDirection, maxDistance))
+					{
+						maxDistance = callback(objects[i]);
+					}
+				}
+			}
+			else
+			{
+				stack[count++] = node.index;
+				stack[count++] = nodeID + 1;
+			}
+		}
+	}
+
+
+	// The number of objects passed to the last build, including ones without colliders
+	size_t getSourceCount() const { return sourceCount; }
+	size_t getObjectCount() const { return objects.size(); }
+
+private:
+	struct Node
+	{
+		AABB aabb;
+		// For leaves, the index of the first object. For branches, the index of the second child
+		int index = 0;
+		// The number of objects in a leaf. Branches have 0
+		int count = 0;
+		// Every collision category of the objects under this node
+		unsigned int categories = 0;
+	};
+
+	// Recursively build nodes for objects in the range [start, end)
+	void buildNode(int nodeID, int start, int end, int depth, std::vector<raylib::Vector3>& centers);
+	// Make a node into a leaf holding the objects in the range [start, end)
+	void makeLeaf(int nodeID, int start, int end);
+
+
+private:
+	std::vector<Node> nodes;
+	// Objects and their boxes, ordered so each leaf refers to a continuous range
+	std::vector<StaticObject*> objects;
+	std::vector<AABB> objectBounds;
+	std::vector<unsigned int> objectCategories;
+
+	size_t sourceCount = 0;
+
+	// Leaves with this many objects or less will not be split
+	static const int maxLeafSize = 4;
+	// Number of buckets used to approximate the surface area heuristic along each axis
+	static const int binCount = 12;
+	// Past this depth, nodes are split in half instead of using the heuristic, which keeps the query stack small
+	static const int maxDepth = 32;
+};